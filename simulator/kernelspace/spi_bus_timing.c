@@ -0,0 +1,73 @@
+#include "spi_simulator.h"
+
+// Timing mode: a transfer returns after the time it would take on the wire. Each bus keeps the
+// end of the last transfer scheduled on it, so transfers on one bus queue behind each other and
+// transfers on different buses overlap.
+
+// Bytes that hold one word in the transfer buffers, as for spidev
+static u32 spi_timing_word_bytes(u8 bits_per_word) {
+    if (bits_per_word <= 8)
+        return 1;
+    if (bits_per_word <= 16)
+        return 2;
+    return 4;
+}
+
+// Clocked bits of len bytes plus the gaps between their words
+static u64 spi_timing_words_ns(u32 len, u8 bits_per_word, u32 speed_hz, u32 word_delay_ns) {
+    u32 bits  = bits_per_word ?: SPI_SIM_DEFAULT_BITS_PER_WORD;
+    u32 words = DIV_ROUND_UP(len, spi_timing_word_bytes(bits));
+
+    if (!words || !speed_hz)
+        return 0;
+    return mul_u64_u32_div((u64) words * bits, NSEC_PER_SEC, speed_hz) + (u64) (words - 1) * word_delay_ns;
+}
+
+// Wire time of one message segment, including the delay after it
+u64 spi_timing_xfer_ns(const struct spi_ioc_transfer *xfer) {
+    return spi_timing_words_ns(xfer->len, xfer->bits_per_word, xfer->speed_hz,
+                               xfer->word_delay_usecs * NSEC_PER_USEC) +
+           (u64) xfer->delay_usecs * NSEC_PER_USEC;
+}
+
+// Wire time of a single full-duplex frame with the settings of the file
+u64 spi_timing_frame_ns(const struct spi_sim_file *sf, u32 len) {
+    return spi_timing_words_ns(len, READ_ONCE(sf->bits_per_word), READ_ONCE(sf->max_speed_hz), 0) +
+           READ_ONCE(spi_cs_delay_ns);
+}
+
+// Book ns of bus time after the transfers already scheduled on the bus and return the time
+// it ends, 0 for none. Does not sleep, so callers may hold their locks.
+ktime_t spi_bus_reserve(struct spi_sim_bus *bus, u64 ns) {
+    ktime_t now = ktime_get();
+    ktime_t end;
+
+    if (!ns)
+        return 0;
+
+    spin_lock(&bus->lock);
+    end             = ktime_add_ns(ktime_after(bus->busy_until, now) ? bus->busy_until : now, ns);
+    bus->busy_until = end;
+    spin_unlock(&bus->lock);
+    return end;
+}
+
+// Sleep on an hrtimer until a reservation has ended. Called with no locks held, outside
+// sequence_srcu and atomic context, so other users of the file are not held up meanwhile.
+void spi_bus_wait(ktime_t end) {
+    if (!end)
+        return;
+
+    // The bus stays booked if the process is killed, as a transfer on the wire would
+    while (!fatal_signal_pending(current)) {
+        set_current_state(TASK_KILLABLE);
+        if (!schedule_hrtimeout(&end, HRTIMER_MODE_ABS))
+            break;
+    }
+    __set_current_state(TASK_RUNNING);
+}
+
+// Book ns of bus time and sleep until it has passed, in the context of spi_bus_wait
+void spi_bus_occupy(struct spi_sim_bus *bus, u64 ns) {
+    spi_bus_wait(spi_bus_reserve(bus, ns));
+}
@@ -0,0 +1,185 @@
+#include "spi_simulator.h"
+
+// Transfer capture. The ring exists only while the trace file is open, so transfers cost a
+// single pointer test when nobody captures. Producers on any CPU reserve a slot with one atomic
+// increment and publish it with its sequence number, the ring overwrites the oldest records when
+// the reader falls behind. The single reader checks the sequence number before and after copying
+// a slot, a record overwritten meanwhile is counted as lost.
+
+struct spi_sim_capture_slot {
+    u64                      seq; // Position + 1 once committed, 0 while being written
+    struct spi_sim_trace_rec rec;
+};
+
+struct spi_sim_capture {
+    atomic64_t                  head; // Next position reserved by a producer
+    u64                         tail; // Next position read, owned by the reader
+    u64                         lost; // Records lost and not reported yet, owned by the reader
+    u32                         mask;
+    wait_queue_head_t           wait;
+    struct mutex                read_mutex; // Readers sharing the file take turns
+    struct spi_sim_capture_slot slots[];
+};
+
+// Record one transfer, tx and rx may be NULL and flags is 0 or SPI_SIM_TRACE_CONT.
+// Called from any context that can take rcu_read_lock.
+void spi_capture(struct spi_sim_dev *dev, u32 mode, u32 flags, u32 speed_hz, u32 seq_id, const u8 *tx, const u8 *rx,
+                 u32 len) {
+    struct spi_sim_capture      *cap;
+    struct spi_sim_capture_slot *slot;
+    u32                          n = min_t(u32, len, SPI_SIM_TRACE_DATA);
+    u64                          pos;
+
+    rcu_read_lock();
+    cap = rcu_dereference(dev->capture);
+    if (!cap)
+        goto out;
+
+    pos  = atomic64_inc_return(&cap->head) - 1;
+    slot = &cap->slots[pos & cap->mask];
+    WRITE_ONCE(slot->seq, 0);
+    smp_wmb();
+
+    slot->rec.ts_ns    = ktime_get_ns();
+    slot->rec.len      = len;
+    slot->rec.speed_hz = speed_hz;
+    slot->rec.seq_id   = seq_id;
+    slot->rec.mode     = mode;
+    slot->rec.flags    = flags | (tx ? SPI_SIM_TRACE_TX : 0) | (rx ? SPI_SIM_TRACE_RX : 0);
+    slot->rec.pad      = 0;
+    if (tx)
+        memcpy(slot->rec.tx, tx, n);
+    if (rx)
+        memcpy(slot->rec.rx, rx, n);
+    memset(slot->rec.tx + (tx ? n : 0), 0, SPI_SIM_TRACE_DATA - (tx ? n : 0));
+    memset(slot->rec.rx + (rx ? n : 0), 0, SPI_SIM_TRACE_DATA - (rx ? n : 0));
+
+    smp_store_release(&slot->seq, pos + 1);
+    if (wq_has_sleeper(&cap->wait))
+        wake_up_interruptible(&cap->wait);
+out:
+    rcu_read_unlock();
+}
+
+// A record or a lost record report can be read
+static bool spi_capture_ready(struct spi_sim_capture *cap) {
+    if (cap->lost || atomic64_read(&cap->head) - cap->tail > cap->mask + 1)
+        return true;
+    return smp_load_acquire(&cap->slots[cap->tail & cap->mask].seq) > cap->tail;
+}
+
+static int spi_capture_open(struct inode *inode, struct file *file) {
+    struct spi_sim_dev     *dev     = inode->i_private;
+    u32                     entries = roundup_pow_of_two(clamp(spi_capture_entries, 64, SZ_1M));
+    struct spi_sim_capture *cap;
+
+    cap = vzalloc(struct_size(cap, slots, entries));
+    if (!cap)
+        return -ENOMEM;
+
+    atomic64_set(&cap->head, 0);
+    cap->mask = entries - 1;
+    init_waitqueue_head(&cap->wait);
+    mutex_init(&cap->read_mutex);
+
+    // One reader at a time, it owns the ring
+    if (cmpxchg((struct spi_sim_capture __force **) &dev->capture, NULL, cap)) {
+        vfree(cap);
+        return -EBUSY;
+    }
+
+    file->private_data = cap;
+    spi_sim_info("Capture of %s started, %u records\n", dev->name, entries);
+    return nonseekable_open(inode, file);
+}
+
+static int spi_capture_release(struct inode *inode, struct file *file) {
+    struct spi_sim_dev *dev = inode->i_private;
+
+    // Wait for the producers still writing into the ring
+    RCU_INIT_POINTER(dev->capture, NULL);
+    synchronize_rcu();
+    vfree(file->private_data);
+    spi_sim_info("Capture of %s stopped\n", dev->name);
+    return 0;
+}
+
+static ssize_t spi_capture_read(struct file *file, char __user *buf, size_t count, loff_t *ppos) {
+    struct spi_sim_capture  *cap     = file->private_data;
+    u64                      entries = cap->mask + 1;
+    size_t                   done    = 0;
+    struct spi_sim_trace_rec rec;
+    int                      ret;
+
+    if (count < sizeof(rec))
+        return -EINVAL;
+
+    while (!spi_capture_ready(cap)) {
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(cap->wait, spi_capture_ready(cap));
+        if (ret)
+            return ret;
+    }
+
+    mutex_lock(&cap->read_mutex);
+    while (count - done >= sizeof(rec)) {
+        struct spi_sim_capture_slot *slot;
+        u64                          head = atomic64_read(&cap->head);
+        u64                          seq;
+
+        // The reader fell more than a lap behind
+        if (head - cap->tail > entries) {
+            cap->lost += head - entries - cap->tail;
+            cap->tail = head - entries;
+        }
+
+        if (cap->lost) {
+            memset(&rec, 0, sizeof(rec));
+            rec.ts_ns  = ktime_get_ns();
+            rec.len    = min_t(u64, cap->lost, U32_MAX);
+            rec.seq_id = SPI_SIM_TRACE_NO_SEQ;
+            rec.flags  = SPI_SIM_TRACE_LOST;
+            cap->lost -= rec.len;
+        } else {
+            slot = &cap->slots[cap->tail & cap->mask];
+            seq  = smp_load_acquire(&slot->seq);
+            if (seq <= cap->tail)
+                break; // Not committed yet
+
+            // Copy, then make sure no producer a lap ahead started on the slot meanwhile
+            if (seq == cap->tail + 1) {
+                rec = slot->rec;
+                smp_rmb();
+            }
+            cap->tail++;
+            if (seq != cap->tail || READ_ONCE(slot->seq) != seq) {
+                cap->lost++;
+                continue;
+            }
+        }
+
+        if (copy_to_user(buf + done, &rec, sizeof(rec))) {
+            mutex_unlock(&cap->read_mutex);
+            return done ? done : -EFAULT;
+        }
+        done += sizeof(rec);
+    }
+    mutex_unlock(&cap->read_mutex);
+    return done;
+}
+
+static __poll_t spi_capture_poll(struct file *file, poll_table *wait) {
+    struct spi_sim_capture *cap = file->private_data;
+
+    poll_wait(file, &cap->wait, wait);
+    return spi_capture_ready(cap) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+const struct file_operations spi_capture_fops = {
+        .owner   = THIS_MODULE,
+        .open    = spi_capture_open,
+        .release = spi_capture_release,
+        .read    = spi_capture_read,
+        .poll    = spi_capture_poll,
+};
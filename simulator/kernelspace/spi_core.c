@@ -1,55 +1,449 @@
 #include "spi_simulator.h"
 
 int spi_open(struct inode *inode, struct file *file) {
-    printk(KERN_INFO "SPI Simulator: Device opened\n");
+    struct spi_sim_file *sf;
+
+    sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+    if (!sf)
+        return -ENOMEM;
+
+    if (kfifo_alloc(&sf->resps, SPI_SIM_RESP_FIFO_SIZE, GFP_KERNEL)) {
+        kfree(sf);
+        return -ENOMEM;
+    }
+
+    sf->dev           = container_of(inode->i_cdev, struct spi_sim_dev, cdev);
+    sf->mode          = SPI_MODE_0;
+    sf->bits_per_word = SPI_SIM_DEFAULT_BITS_PER_WORD;
+    sf->max_speed_hz  = SPI_SIM_DEFAULT_MAX_SPEED_HZ;
+    mutex_init(&sf->ring_mutex);
+    mutex_init(&sf->resp_mutex);
+    init_waitqueue_head(&sf->resp_wait);
+
+    file->private_data = sf;
+    spi_sim_dbg("Device opened\n");
     return 0;
 }
 
+static void spi_ring_free(struct spi_sim_ring *ring) {
+    if (!ring)
+        return;
+    hrtimer_cancel(&ring->timer);
+    kvfree(ring->posts);
+    vfree(ring->mem);
+    kfree(ring);
+}
+
 int spi_release(struct inode *inode, struct file *file) {
-    printk(KERN_INFO "SPI Simulator: Device closed\n");
+    struct spi_sim_file *sf = file->private_data;
+
+    // Mappings hold a file reference, so the ring is no longer mapped here
+    spi_ring_free(sf->ring);
+    kfifo_free(&sf->resps);
+    kfree(sf);
+    file->private_data = NULL;
+    spi_sim_dbg("Device closed\n");
     return 0;
 }
 
+static bool spi_resp_ready(struct spi_sim_file *sf) {
+    return !kfifo_is_empty(&sf->resps);
+}
+
+// A write is only run when its whole response fits next to the ones still on the bus
+static bool spi_resp_room(struct spi_sim_file *sf) {
+    return kfifo_avail(&sf->resps) >= READ_ONCE(sf->resp_reserved) + SPI_SIM_CHUNK_SIZE;
+}
+
+// Every read returns the oldest response of a write, shorter buffers get its start and the rest is dropped
 ssize_t spi_read_file(struct file *file, char __user *buffer, size_t len, loff_t *offset) {
-    printk(KERN_INFO "SPI Simulator: Read operation\n");
-    return 0;
+    struct spi_sim_file *sf = file->private_data;
+    unsigned int         copied;
+    int                  ret;
+
+    for (;;) {
+        ret = mutex_lock_interruptible(&sf->resp_mutex);
+        if (ret)
+            return ret;
+        if (spi_resp_ready(sf))
+            break;
+        mutex_unlock(&sf->resp_mutex);
+
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(sf->resp_wait, spi_resp_ready(sf));
+        if (ret)
+            return ret;
+    }
+
+    ret = kfifo_to_user(&sf->resps, buffer, len, &copied);
+    mutex_unlock(&sf->resp_mutex);
+    if (ret)
+        return ret;
+
+    wake_up_interruptible(&sf->resp_wait);
+    spi_sim_dbg("Read %u bytes of response\n", copied);
+    return copied;
 }
 
-ssize_t spi_write_file(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
-    char                 cmd[256];
-    char                 response[256] = {0};
-    struct spi_sequence *seq;
-    bool                 found = false;
+// Run one written command as a chip select frame and fill out with its response, returns the
+// response length. out holds SPI_SIM_CHUNK_SIZE bytes, at least cmd_len of them are written.
+static u32 spi_write_frame(struct spi_sim_file *sf, const u8 *cmd, u32 cmd_len, u8 *out) {
+    const struct spi_seq_table *table;
+    const struct spi_seq_entry *seq;
+    u32                         len = 0;
+    int                         srcu_idx;
+
+    // With a device model the write is one chip select frame, the response is what MISO carried
+    if (sf->dev->model) {
+        struct spi_model_frame frame = {0};
 
-    printk(KERN_INFO "SPI Simulator: Write operation\n");
+        sf->dev->model->xfer(sf->dev, &frame, cmd, out, cmd_len);
+        if (sf->dev->model->frame_end)
+            sf->dev->model->frame_end(sf->dev, &frame);
+        trace_spi_sim_transfer(cmd, out, cmd_len, 0, true);
+        spi_capture(sf->dev, READ_ONCE(sf->mode), 0, READ_ONCE(sf->max_speed_hz), SPI_SIM_TRACE_NO_SEQ, cmd, out,
+                    cmd_len);
+        return cmd_len;
+    }
+
+    // Look the command up, the response comes from the table and may refer to command bytes
+    srcu_idx = srcu_read_lock(&sequence_srcu);
+    table    = srcu_dereference(sf->dev->table, &sequence_srcu);
+    seq      = spi_seq_lookup(table, cmd, cmd_len);
+    if (seq) {
+        const struct spi_seq_resp *resp = spi_seq_respond(table, seq);
+
+        spi_stats_inc(sf->dev, seq_hits);
+        // At most one chunk of response, padded with zeros to the command for the capture
+        len = min_t(u32, resp->len, SPI_SIM_CHUNK_SIZE);
+        spi_seq_copy(table, resp, cmd, cmd_len, out, 0, len);
+        if (len < cmd_len)
+            memset(out + len, 0, cmd_len - len);
+        trace_spi_sim_transfer(cmd, out, cmd_len, 0, true);
+        spi_seq_finish(table, seq);
+        spi_capture(sf->dev, READ_ONCE(sf->mode), 0, READ_ONCE(sf->max_speed_hz), spi_seq_id(table, seq), cmd, out,
+                    cmd_len);
+    }
+    srcu_read_unlock(&sequence_srcu, srcu_idx);
+
+    spi_sim_dbg("Write %*ph: %s\n", (int) min_t(u32, cmd_len, 64), cmd, seq ? "matched" : "no matching sequence");
+    // An empty response reads as the zeros clocked during the frame, a 0 byte read() is end of file
+    if (seq)
+        return len ? len : cmd_len;
 
-    if (count >= sizeof(cmd))
+    // Default response
+    spi_stats_inc(sf->dev, seq_misses);
+    trace_spi_sim_transfer(cmd, NULL, cmd_len, 0, false);
+    spi_capture(sf->dev, READ_ONCE(sf->mode), 0, READ_ONCE(sf->max_speed_hz), SPI_SIM_TRACE_NO_SEQ, cmd, NULL,
+                cmd_len);
+    return scnprintf((char *) out, SPI_SIM_CHUNK_SIZE, "Unknown command: %*ph", (int) min_t(u32, cmd_len, 64), cmd) + 1;
+}
+
+// Every write is one command, its response is queued for read()
+ssize_t spi_write_file(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    struct spi_sim_file *sf = file->private_data;
+    u8                  *cmd;
+    u8                  *out;
+    u32                  len;
+    u32                  held;
+    u32                  turn;
+    ktime_t              end = 0;
+    int                  ret;
+
+    // Commands are at most one chunk long
+    if (!count || count > SPI_SIM_CHUNK_SIZE)
         return -EINVAL;
 
-    if (copy_from_user(cmd, buf, count))
+    // Command followed by its response, the response may refer to command bytes
+    cmd = kmalloc(count + SPI_SIM_CHUNK_SIZE, GFP_KERNEL);
+    if (!cmd)
+        return -ENOMEM;
+    out = cmd + count;
+
+    if (copy_from_user(cmd, buf, count)) {
+        kfree(cmd);
         return -EFAULT;
+    }
+
+    // Wait for room in the response queue, a command only runs when its response fits
+    for (;;) {
+        ret = mutex_lock_interruptible(&sf->resp_mutex);
+        if (ret)
+            goto out;
+        if (spi_resp_room(sf))
+            break;
+        mutex_unlock(&sf->resp_mutex);
+
+        ret = -EAGAIN;
+        if (file->f_flags & O_NONBLOCK)
+            goto out;
+        ret = wait_event_interruptible(sf->resp_wait, spi_resp_room(sf));
+        if (ret)
+            goto out;
+    }
+
+    spi_stats_inc(sf->dev, transfers);
+    spi_stats_add(sf->dev, bytes_in, count);
+    len = spi_write_frame(sf, cmd, count, out);
+
+    // In timing mode the response shows once the frame has been on the bus. The sleep is
+    // without the mutex, the room and the place in the queue stay held meanwhile.
+    if (READ_ONCE(spi_timing))
+        end = spi_bus_reserve(sf->dev->bus, spi_timing_frame_ns(sf, count));
+    turn = sf->resp_next++;
+    if (end || turn != sf->resp_turn) {
+        held = len + kfifo_recsize(&sf->resps);
+        sf->resp_reserved += held;
+        mutex_unlock(&sf->resp_mutex);
+
+        spi_bus_wait(end);
+        // Sleepers may wake out of order, responses are still queued in bus order
+        wait_event(sf->resp_wait, READ_ONCE(sf->resp_turn) == turn);
+
+        mutex_lock(&sf->resp_mutex);
+        sf->resp_reserved -= held;
+    }
+    kfifo_in(&sf->resps, out, len);
+    sf->resp_turn++;
+    mutex_unlock(&sf->resp_mutex);
+
+    wake_up(&sf->resp_wait);
+    spi_stats_add(sf->dev, bytes_out, len);
+    ret = count;
+out:
+    kfree(cmd);
+    return ret;
+}
+
+// Make completions up to cq_tail visible to the client
+static void spi_ring_publish(struct spi_sim_ring *ring, u32 sq_head, u32 cq_tail) {
+    smp_store_release(&ring->hdr->sq_head, sq_head);
+    smp_store_release(&ring->hdr->cq_tail, cq_tail);
+    WRITE_ONCE(ring->posted_cq_tail, cq_tail);
+    wake_up_interruptible(&ring->wait);
+}
 
-    cmd[count] = '\0';
+// Timing mode, publish every batch that has left the bus and wait for the next one
+static enum hrtimer_restart spi_ring_timer(struct hrtimer *timer) {
+    struct spi_sim_ring *ring = container_of(timer, struct spi_sim_ring, timer);
+    enum hrtimer_restart ret  = HRTIMER_NORESTART;
+    ktime_t              now  = ktime_get();
+    unsigned long        flags;
 
-    // Sequence listesinde ara
-    mutex_lock(&sequence_mutex);
-    list_for_each_entry(seq, &sequence_list, list) {
-        if (strcmp(seq->received, cmd) == 0) {
-            strncpy(response, seq->response, sizeof(response) - 1);
-            found = true;
+    spin_lock_irqsave(&ring->post_lock, flags);
+    while (ring->post_head != ring->post_tail) {
+        struct spi_sim_ring_post *post = &ring->posts[ring->post_head & (ring->entries - 1)];
+
+        if (ktime_after(post->end, now)) {
+            hrtimer_set_expires(timer, post->end);
+            ret = HRTIMER_RESTART;
             break;
         }
+        spi_ring_publish(ring, post->sq_head, post->cq_tail);
+        ring->post_head++;
     }
-    mutex_unlock(&sequence_mutex);
+    spin_unlock_irqrestore(&ring->post_lock, flags);
+    return ret;
+}
+
+// SPI_SIM_IOC_RING_SETUP: allocate the shared ring of this file, once
+int spi_ring_setup(struct spi_sim_file *sf, struct spi_sim_ring_setup __user *argp) {
+    struct spi_sim_ring_setup setup;
+    struct spi_sim_ring      *ring;
+    size_t                    data_off;
+    size_t                    size;
+    int                       ret = 0;
+
+    if (copy_from_user(&setup, argp, sizeof(setup)))
+        return -EFAULT;
+
+    if (!is_power_of_2(setup.entries) || setup.entries > SPI_SIM_RING_MAX_ENTRIES ||
+        !is_power_of_2(setup.slot_size) || setup.slot_size > SPI_SIM_RING_MAX_SLOT)
+        return -EINVAL;
+
+    // Header, submission and completion entries, then the cache line aligned data slots
+    data_off = ALIGN(sizeof(struct spi_sim_ring_hdr) +
+                             setup.entries * (sizeof(struct spi_sim_ring_sqe) + sizeof(struct spi_sim_ring_cqe)),
+                     SMP_CACHE_BYTES);
+    size     = PAGE_ALIGN(data_off + (size_t) setup.entries * setup.slot_size);
+    if (size > SPI_SIM_RING_MAX_SIZE)
+        return -E2BIG;
 
-    if (!found) {
-        // Varsayılan yanıt
-        snprintf(response, sizeof(response), "Unknown command: %s", cmd);
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring)
+        return -ENOMEM;
+
+    ring->mem   = vmalloc_user(size);
+    ring->posts = kvmalloc_array(setup.entries, sizeof(*ring->posts), GFP_KERNEL);
+    if (!ring->mem || !ring->posts) {
+        kvfree(ring->posts);
+        vfree(ring->mem);
+        kfree(ring);
+        return -ENOMEM;
+    }
+    ring->size      = size;
+    ring->entries   = setup.entries;
+    ring->slot_size = setup.slot_size;
+    ring->hdr       = ring->mem;
+    ring->sqes      = (struct spi_sim_ring_sqe *) (ring->hdr + 1);
+    ring->cqes      = (struct spi_sim_ring_cqe *) (ring->sqes + setup.entries);
+    ring->data      = (u8 *) ring->mem + data_off;
+    init_waitqueue_head(&ring->wait);
+    spin_lock_init(&ring->post_lock);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&ring->timer, spi_ring_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+#else
+    hrtimer_init(&ring->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    ring->timer.function = spi_ring_timer;
+#endif
+
+    ring->hdr->entries   = setup.entries;
+    ring->hdr->slot_size = setup.slot_size;
+    ring->hdr->sqe_off   = (u8 *) ring->sqes - (u8 *) ring->mem;
+    ring->hdr->cqe_off   = (u8 *) ring->cqes - (u8 *) ring->mem;
+    ring->hdr->data_off  = data_off;
+
+    mutex_lock(&sf->ring_mutex);
+    if (sf->ring)
+        ret = -EBUSY;
+    else
+        smp_store_release(&sf->ring, ring); // poll() reads it without the mutex
+    mutex_unlock(&sf->ring_mutex);
+
+    if (ret) {
+        spi_ring_free(ring);
+        return ret;
     }
 
-    // Yanıtı kullanıcıya gönder
-    if (copy_to_user((void __user *) buf, response, strlen(response) + 1))
+    setup.mmap_size = size;
+    if (copy_to_user(argp, &setup, sizeof(setup)))
         return -EFAULT;
 
-    return strlen(response) + 1;
+    spi_sim_info("Ring of %u x %u bytes set up for %s\n", setup.entries, setup.slot_size, sf->dev->name);
+    return 0;
+}
+
+// Run the pending submissions in place and post their completions, returns the number run.
+// Indexes and entries come from shared memory and are validated before use. In timing mode
+// the completions are published by the timer once the batch has left the bus, nothing here
+// sleeps.
+static int spi_ring_process(struct spi_sim_file *sf, struct spi_sim_ring *ring) {
+    const struct spi_seq_table *table;
+    struct spi_sim_ring_post   *post;
+    u32                         mask = ring->entries - 1;
+    u32                         tail;
+    u32                         cq_head;
+    u64                         wire_ns = 0;
+    ktime_t                     end;
+    unsigned long               flags;
+    int                         srcu_idx;
+    int                         done = 0;
+
+    // Every post holds at least one completion, a client that moves cq_head past the
+    // published ones could otherwise queue more batches than there are posts
+    if (ring->post_tail - READ_ONCE(ring->post_head) >= ring->entries)
+        return 0;
+
+    tail    = smp_load_acquire(&ring->hdr->sq_tail);
+    cq_head = READ_ONCE(ring->hdr->cq_head);
+
+    srcu_idx = srcu_read_lock(&sequence_srcu);
+    table    = srcu_dereference(sf->dev->table, &sequence_srcu);
+
+    // Stop when the completion ring is full, the rest waits for the next doorbell
+    while (ring->sq_head != tail && ring->cq_tail - cq_head < ring->entries) {
+        struct spi_sim_ring_sqe *sqe       = &ring->sqes[ring->sq_head & mask];
+        struct spi_sim_ring_cqe *cqe       = &ring->cqes[ring->cq_tail & mask];
+        u64                      user_data = READ_ONCE(sqe->user_data);
+        u32                      slot      = READ_ONCE(sqe->slot);
+        u32                      len       = READ_ONCE(sqe->len);
+
+        if (slot >= ring->entries || len > ring->slot_size) {
+            cqe->res = -EINVAL;
+        } else {
+            spi_transfer_buf(sf, table, ring->data + (size_t) slot * ring->slot_size, len);
+            cqe->res = len;
+            if (READ_ONCE(spi_timing))
+                wire_ns += spi_timing_frame_ns(sf, len);
+        }
+        cqe->user_data = user_data;
+
+        ring->sq_head++;
+        ring->cq_tail++;
+        done++;
+    }
+
+    srcu_read_unlock(&sequence_srcu, srcu_idx);
+
+    if (!done)
+        return 0;
+
+    // Timing mode, completions are posted once the batch has been on the bus. A batch
+    // behind one still waiting for the timer is posted after it, so cq_tail only grows.
+    end = spi_bus_reserve(sf->dev->bus, wire_ns);
+    spin_lock_irqsave(&ring->post_lock, flags);
+    if (!end && ring->post_head == ring->post_tail) {
+        spi_ring_publish(ring, ring->sq_head, ring->cq_tail);
+    } else {
+        if (ring->post_head != ring->post_tail)
+            end = max(end, ring->posts[(ring->post_tail - 1) & mask].end);
+        post          = &ring->posts[ring->post_tail++ & mask];
+        post->end     = end;
+        post->sq_head = ring->sq_head;
+        post->cq_tail = ring->cq_tail;
+        // The timer is idle when its queue was empty, otherwise it reaches this post itself
+        if (ring->post_tail - ring->post_head == 1)
+            hrtimer_start(&ring->timer, end, HRTIMER_MODE_ABS);
+    }
+    spin_unlock_irqrestore(&ring->post_lock, flags);
+    return done;
+}
+
+// SPI_SIM_IOC_RING_ENTER: doorbell
+int spi_ring_enter(struct spi_sim_file *sf) {
+    int ret;
+
+    mutex_lock(&sf->ring_mutex);
+    ret = sf->ring ? spi_ring_process(sf, sf->ring) : -ENXIO;
+    mutex_unlock(&sf->ring_mutex);
+    return ret;
+}
+
+int spi_mmap(struct file *file, struct vm_area_struct *vma) {
+    struct spi_sim_file *sf   = file->private_data;
+    unsigned long        size = vma->vm_end - vma->vm_start;
+    int                  ret;
+
+    mutex_lock(&sf->ring_mutex);
+    if (!sf->ring)
+        ret = -ENXIO;
+    else if (vma->vm_pgoff || size > sf->ring->size)
+        ret = -EINVAL;
+    else
+        ret = remap_vmalloc_range(vma, sf->ring->mem, 0);
+    mutex_unlock(&sf->ring_mutex);
+    return ret;
+}
+
+// Reports published completions and queued responses as readable, the ring only runs on
+// SPI_SIM_IOC_RING_ENTER
+__poll_t spi_poll(struct file *file, poll_table *wait) {
+    struct spi_sim_file *sf   = file->private_data;
+    struct spi_sim_ring *ring = smp_load_acquire(&sf->ring);
+    __poll_t             mask = 0;
+
+    if (ring) {
+        poll_wait(file, &ring->wait, wait);
+        if (READ_ONCE(ring->posted_cq_tail) != READ_ONCE(ring->hdr->cq_head))
+            mask |= EPOLLIN | EPOLLRDNORM;
+    }
+
+    // Responses of write() waiting for read(), and room for the next write
+    poll_wait(file, &sf->resp_wait, wait);
+    if (spi_resp_ready(sf))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (spi_resp_room(sf))
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    return mask;
 }
@@ -0,0 +1,323 @@
+#include "spi_simulator.h"
+
+// Bytes clocked out while the peripheral does not drive MISO
+#define SPI_MODEL_IDLE 0xFF
+
+static void spi_model_idle(u8 *rx, u32 len) {
+    if (rx)
+        memset(rx, SPI_MODEL_IDLE, len);
+}
+
+// Register map: the first byte of a frame is the register address with bit 7 set for reads,
+// the following bytes read or write consecutive registers.
+#define SPI_REGMAP_SIZE 128
+#define SPI_REGMAP_READ 0x80
+
+struct spi_regmap_model {
+    spinlock_t lock;
+    u8         regs[SPI_REGMAP_SIZE];
+};
+
+static int spi_regmap_init(struct spi_sim_dev *dev) {
+    struct spi_regmap_model *map;
+
+    map = kzalloc(sizeof(*map), GFP_KERNEL);
+    if (!map)
+        return -ENOMEM;
+
+    spin_lock_init(&map->lock);
+    dev->model_priv = map;
+    return 0;
+}
+
+static void spi_regmap_exit(struct spi_sim_dev *dev) {
+    kfree(dev->model_priv);
+    dev->model_priv = NULL;
+}
+
+static void spi_regmap_xfer(struct spi_sim_dev *dev, struct spi_model_frame *frame, const u8 *tx, u8 *rx, u32 len) {
+    struct spi_regmap_model *map = dev->model_priv;
+    u32                      i;
+
+    spin_lock(&map->lock);
+    for (i = 0; i < len; i++, frame->pos++) {
+        u8 in = tx ? tx[i] : 0; // Read before rx[i], the buffers may be the same
+
+        if (frame->pos == 0) {
+            frame->op   = in;
+            frame->addr = frame->op & ~SPI_REGMAP_READ;
+            if (rx)
+                rx[i] = SPI_MODEL_IDLE;
+            continue;
+        }
+
+        if (tx && !(frame->op & SPI_REGMAP_READ))
+            map->regs[frame->addr] = in;
+        if (rx)
+            rx[i] = (frame->op & SPI_REGMAP_READ) ? map->regs[frame->addr] : SPI_MODEL_IDLE;
+        frame->addr = (frame->addr + 1) % SPI_REGMAP_SIZE;
+    }
+    spin_unlock(&map->lock);
+}
+
+static const struct spi_model_ops spi_regmap_ops = {
+        .name = "regmap",
+        .init = spi_regmap_init,
+        .exit = spi_regmap_exit,
+        .xfer = spi_regmap_xfer,
+};
+
+// SPI NOR flash with 3 byte addresses. Operations complete instantly, so WIP never reads as busy.
+#define SPI_NOR_OP_WRSR      0x01
+#define SPI_NOR_OP_PP        0x02
+#define SPI_NOR_OP_READ      0x03
+#define SPI_NOR_OP_WRDI      0x04
+#define SPI_NOR_OP_RDSR      0x05
+#define SPI_NOR_OP_WREN      0x06
+#define SPI_NOR_OP_FAST_READ 0x0B
+#define SPI_NOR_OP_SE        0x20
+#define SPI_NOR_OP_CE        0x60
+#define SPI_NOR_OP_RDID      0x9F
+#define SPI_NOR_OP_CE_ALT    0xC7
+#define SPI_NOR_OP_BE        0xD8
+
+#define SPI_NOR_SR_WEL    (1 << 1)
+#define SPI_NOR_PAGE_SIZE 256
+#define SPI_NOR_MIN_SIZE  SZ_64K
+#define SPI_NOR_MAX_SIZE  SZ_16M // Largest size reachable with 3 address bytes
+#define SPI_NOR_MFR_ID    0xEF
+
+struct spi_nor_model {
+    u8                 *mem;
+    u32                 size; // Power of two
+    u8                  status;
+    struct rw_semaphore lock; // Readers copy out of mem, program and erase take it for writing
+};
+
+// Opcode, address and dummy bytes before the data phase
+static u32 spi_nor_header_len(u8 op) {
+    switch (op) {
+        case SPI_NOR_OP_READ:
+        case SPI_NOR_OP_PP:
+        case SPI_NOR_OP_SE:
+        case SPI_NOR_OP_BE:
+            return 4;
+        case SPI_NOR_OP_FAST_READ:
+            return 5;
+        default:
+            return 1;
+    }
+}
+
+// Load the device image when one exists, the rest of the array reads as erased
+static int spi_nor_load_image(struct spi_sim_dev *dev, struct spi_nor_model *nor) {
+    struct file *fp;
+    char         path[64];
+    loff_t       pos = 0;
+    ssize_t      ret;
+
+    snprintf(path, sizeof(path), SPI_SIM_DEVICE_IMAGE_FILE, dev->name);
+    fp = filp_open(path, O_RDONLY, 0);
+    if (IS_ERR(fp))
+        return PTR_ERR(fp) == -ENOENT ? 0 : PTR_ERR(fp);
+
+    ret = kernel_read(fp, nor->mem, nor->size, &pos);
+    filp_close(fp, NULL);
+    if (ret < 0)
+        return ret;
+
+    spi_sim_info("Loaded %zd bytes of flash image %s\n", ret, path);
+    return 0;
+}
+
+static int spi_nor_init(struct spi_sim_dev *dev) {
+    struct spi_nor_model *nor;
+    u32                   size = (u32) spi_flash_size_kb * SZ_1K;
+    int                   ret;
+
+    if (spi_flash_size_kb <= 0 || !is_power_of_2(size) || size < SPI_NOR_MIN_SIZE || size > SPI_NOR_MAX_SIZE) {
+        printk(KERN_ERR "SPI Simulator: flash_size_kb must be a power of two between 64 and 16384\n");
+        return -EINVAL;
+    }
+
+    nor = kzalloc(sizeof(*nor), GFP_KERNEL);
+    if (!nor)
+        return -ENOMEM;
+
+    nor->mem = vmalloc(size);
+    if (!nor->mem) {
+        kfree(nor);
+        return -ENOMEM;
+    }
+    nor->size = size;
+    init_rwsem(&nor->lock);
+    memset(nor->mem, 0xFF, size);
+
+    ret = spi_nor_load_image(dev, nor);
+    if (ret) {
+        printk(KERN_ERR "SPI Simulator: Failed to load flash image for %s: %d\n", dev->name, ret);
+        vfree(nor->mem);
+        kfree(nor);
+        return ret;
+    }
+
+    dev->model_priv = nor;
+    return 0;
+}
+
+static void spi_nor_exit(struct spi_sim_dev *dev) {
+    struct spi_nor_model *nor = dev->model_priv;
+
+    vfree(nor->mem);
+    kfree(nor);
+    dev->model_priv = NULL;
+}
+
+// Copy array data starting at the frame address, reads wrap around at the end of the array
+static void spi_nor_read(struct spi_nor_model *nor, struct spi_model_frame *frame, u8 *rx, u32 len) {
+    down_read(&nor->lock);
+    while (len) {
+        u32 n = min(len, nor->size - frame->addr);
+
+        memcpy(rx, nor->mem + frame->addr, n);
+        frame->addr = (frame->addr + n) & (nor->size - 1);
+        rx += n;
+        len -= n;
+    }
+    up_read(&nor->lock);
+}
+
+// Programming can only clear bits, the address wraps inside the page
+static void spi_nor_program(struct spi_nor_model *nor, struct spi_model_frame *frame, const u8 *tx, u32 len) {
+    u32 page = frame->addr & ~(SPI_NOR_PAGE_SIZE - 1);
+    u32 i;
+
+    down_write(&nor->lock);
+    if (nor->status & SPI_NOR_SR_WEL) {
+        for (i = 0; i < len; i++) {
+            nor->mem[frame->addr] &= tx[i];
+            frame->addr = page | ((frame->addr + 1) & (SPI_NOR_PAGE_SIZE - 1));
+        }
+    }
+    up_write(&nor->lock);
+}
+
+static void spi_nor_xfer(struct spi_sim_dev *dev, struct spi_model_frame *frame, const u8 *tx, u8 *rx, u32 len) {
+    struct spi_nor_model *nor = dev->model_priv;
+    static const u8       id[] = {SPI_NOR_MFR_ID, 0x40};
+    u32                   i;
+
+    // Opcode and address phase, MISO is not driven
+    while (len && frame->pos < spi_nor_header_len(frame->op)) {
+        u8 byte = tx ? *tx++ : 0;
+
+        if (frame->pos == 0)
+            frame->op = byte;
+        else if (frame->pos < 4)
+            frame->addr = ((frame->addr << 8) | byte) & (nor->size - 1);
+        if (rx)
+            *rx++ = SPI_MODEL_IDLE;
+        frame->pos++;
+        len--;
+    }
+    if (!len)
+        return;
+
+    switch (frame->op) {
+        case SPI_NOR_OP_READ:
+        case SPI_NOR_OP_FAST_READ:
+            if (rx)
+                spi_nor_read(nor, frame, rx, len);
+            else
+                frame->addr = (frame->addr + len) & (nor->size - 1);
+            break;
+
+        case SPI_NOR_OP_PP:
+            if (tx)
+                spi_nor_program(nor, frame, tx, len);
+            spi_model_idle(rx, len);
+            break;
+
+        case SPI_NOR_OP_RDSR:
+            if (rx)
+                memset(rx, READ_ONCE(nor->status), len);
+            break;
+
+        case SPI_NOR_OP_RDID:
+            for (i = 0; rx && i < len; i++) {
+                u32 idx = frame->pos - 1 + i;
+
+                if (idx < 2)
+                    rx[i] = id[idx];
+                else if (idx == 2)
+                    rx[i] = ilog2(nor->size); // Capacity code, 0x18 for 16 MiB
+                else
+                    rx[i] = SPI_MODEL_IDLE;
+            }
+            break;
+
+        default:
+            spi_model_idle(rx, len);
+            break;
+    }
+    frame->pos += len;
+}
+
+// Write enable, erase and the end of page program take effect when chip select goes high
+static void spi_nor_frame_end(struct spi_sim_dev *dev, struct spi_model_frame *frame) {
+    struct spi_nor_model *nor  = dev->model_priv;
+    u32                   size = 0;
+
+    down_write(&nor->lock);
+    switch (frame->op) {
+        case SPI_NOR_OP_WREN:
+            nor->status |= SPI_NOR_SR_WEL;
+            break;
+        case SPI_NOR_OP_WRDI:
+        case SPI_NOR_OP_WRSR:
+        case SPI_NOR_OP_PP:
+            nor->status &= ~SPI_NOR_SR_WEL;
+            break;
+        case SPI_NOR_OP_SE:
+            size = SZ_4K;
+            break;
+        case SPI_NOR_OP_BE:
+            size = SZ_64K;
+            break;
+        case SPI_NOR_OP_CE:
+        case SPI_NOR_OP_CE_ALT:
+            size = nor->size;
+            break;
+    }
+
+    // Erase commands with a complete address, only while write enabled
+    if (size && frame->pos >= spi_nor_header_len(frame->op) && (nor->status & SPI_NOR_SR_WEL)) {
+        memset(nor->mem + (frame->addr & ~(size - 1)), 0xFF, size);
+        nor->status &= ~SPI_NOR_SR_WEL;
+    }
+    up_write(&nor->lock);
+}
+
+static const struct spi_model_ops spi_nor_ops = {
+        .name      = "nor",
+        .init      = spi_nor_init,
+        .exit      = spi_nor_exit,
+        .xfer      = spi_nor_xfer,
+        .frame_end = spi_nor_frame_end,
+};
+
+static const struct spi_model_ops *const spi_models[] = {
+        &spi_regmap_ops,
+        &spi_nor_ops,
+};
+
+// Find a model by name, NULL selects the sequence table
+const struct spi_model_ops *spi_model_find(const char *name) {
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(spi_models); i++) {
+        if (!strcmp(spi_models[i]->name, name))
+            return spi_models[i];
+    }
+    return NULL;
+}
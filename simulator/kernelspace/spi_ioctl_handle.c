@@ -1,402 +1,600 @@
 #include "spi_simulator.h"
 
-long spi_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
-    printk(KERN_INFO "SPI Simulator: IOCTL command received: %u (0x%x)\n", cmd, cmd);
+// State of the current chip select frame. Write segments add to the frame command,
+// read segments continue the response of the last matching command.
+// Devices with a model keep their own progress in model instead.
+struct spi_frame {
+    struct spi_model_frame model;
+    u32                    len; // Bytes written in this frame
+    u32                    cmd_len; // Bytes kept in cmd, at most cmd_cap
+    u32                    cmd_cap; // Longest key of the table, later bytes never take part in matching
+    const struct spi_seq_entry *seq; // Last match, its response is taken by the first read
+    const struct spi_seq_resp  *resp;
+    u32                    resp_pos;
+    u32                    segs; // Segments run in this frame
+    u32                    mode; // SPI mode of the message, for the capture
+    u8                     cmd[];
+};
+
+// Bounce buffers shared by all segments of a message
+struct spi_bounce {
+    u8 *tx;
+    u8 *rx;
+    u32 size;
+};
+
+static void spi_stats_lookup(struct spi_sim_dev *dev, const struct spi_seq_entry *seq) {
+    if (seq)
+        spi_stats_inc(dev, seq_hits);
+    else
+        spi_stats_inc(dev, seq_misses);
+}
+
+static void spi_frame_reset(struct spi_frame *frame) {
+    memset(&frame->model, 0, sizeof(frame->model));
+    frame->len      = 0;
+    frame->cmd_len  = 0;
+    frame->seq      = NULL;
+    frame->resp     = NULL;
+    frame->resp_pos = 0;
+    frame->segs     = 0;
+}
+
+// Capture flag of a segment that is not the first of its chip select frame
+static u32 spi_frame_cont(const struct spi_frame *frame) {
+    return frame->segs ? SPI_SIM_TRACE_CONT : 0;
+}
+
+// Write operation, the bytes become part of the frame command. Only the bytes that can
+// still take part in matching are copied, the rest of a long write only counts for its length.
+static int spi_transfer_write(struct spi_sim_dev *dev, const struct spi_seq_table *table, struct spi_frame *frame,
+                              const struct spi_ioc_transfer *xfer, struct spi_bounce *bounce) {
+    const u8 __user            *tx_user = u64_to_user_ptr(xfer->tx_buf);
+    u32                         len     = min(xfer->len, frame->cmd_cap - frame->cmd_len);
+    const struct spi_seq_entry *seq     = NULL;
+
+    if (copy_from_user(frame->cmd + frame->cmd_len, tx_user, len)) {
+        spi_sim_err("Failed to copy tx buffer from user\n");
+        return -EFAULT;
+    }
+    frame->cmd_len += len;
+    frame->len += xfer->len;
+
+    seq = spi_seq_lookup(table, frame->cmd, frame->len);
+    spi_stats_lookup(dev, seq);
+    if (seq) {
+        frame->seq      = seq;
+        frame->resp     = NULL;
+        frame->resp_pos = 0;
+    }
+
+    if (trace_spi_sim_transfer_enabled() || spi_capture_enabled(dev)) {
+        len = min(xfer->len, bounce->size);
+        if (!copy_from_user(bounce->tx, tx_user, len)) {
+            trace_spi_sim_transfer(bounce->tx, NULL, len, xfer->speed_hz, seq != NULL);
+            spi_capture(dev, frame->mode, spi_frame_cont(frame), xfer->speed_hz, spi_seq_id(table, seq), bounce->tx,
+                        NULL, xfer->len);
+        }
+    }
+    return 0;
+}
+
+// Read operation, continue the pending response of the frame or fill with dummy data
+static int spi_transfer_read(struct spi_sim_dev *dev, const struct spi_seq_table *table, struct spi_frame *frame,
+                             const struct spi_ioc_transfer *xfer, struct spi_bounce *bounce) {
+    u8 __user *rx_user = u64_to_user_ptr(xfer->rx_buf);
+    u32        off;
+    u32        n;
+
+    // The response of the last match is picked when the host starts reading it
+    if (frame->seq && !frame->resp)
+        frame->resp = spi_seq_respond(table, frame->seq);
+
+    for (off = 0; off < xfer->len; off += n) {
+        u32 resp = 0;
+
+        n = min(xfer->len - off, bounce->size);
+        if (frame->resp && frame->resp_pos < frame->resp->len) {
+            resp = min(n, frame->resp->len - frame->resp_pos);
+            spi_seq_copy(table, frame->resp, frame->cmd, frame->cmd_len, bounce->rx, frame->resp_pos, resp);
+            frame->resp_pos += resp;
+        }
+        memset(bounce->rx + resp, 0xAA, n - resp);
+
+        if (copy_to_user(rx_user + off, bounce->rx, n)) {
+            spi_sim_err("Failed to copy rx buffer to user\n");
+            return -EFAULT;
+        }
+        if (off == 0) {
+            trace_spi_sim_transfer(NULL, bounce->rx, n, xfer->speed_hz, resp > 0);
+            spi_capture(dev, frame->mode, spi_frame_cont(frame), xfer->speed_hz,
+                        resp ? spi_seq_id(table, frame->seq) : SPI_SIM_TRACE_NO_SEQ, NULL, bounce->rx, xfer->len);
+        }
+    }
+    return 0;
+}
+
+// Full-duplex operation, the response is clocked out while the command is clocked in.
+// The whole transfer is the command, only its first chunk is copied in since no key is longer.
+static int spi_transfer_duplex(struct spi_sim_dev *dev, const struct spi_seq_table *table, struct spi_frame *frame,
+                               const struct spi_ioc_transfer *xfer, struct spi_bounce *bounce) {
+    const u8 __user            *tx_user  = u64_to_user_ptr(xfer->tx_buf);
+    u8 __user                  *rx_user  = u64_to_user_ptr(xfer->rx_buf);
+    const struct spi_seq_entry *seq      = NULL;
+    const struct spi_seq_resp  *resp     = NULL;
+    u32                         resp_len = 0;
+    u32                         req_len  = 0;
+    u32                         off;
+    u32                         n;
+
+    for (off = 0; off < xfer->len; off += n) {
+        n = min(xfer->len - off, bounce->size);
+
+        if (off == 0) {
+            if (copy_from_user(bounce->tx, tx_user, n)) {
+                spi_sim_err("Failed to copy tx buffer from user\n");
+                return -EFAULT;
+            }
+            seq = spi_seq_lookup(table, bounce->tx, xfer->len);
+            spi_stats_lookup(dev, seq);
+            if (seq) {
+                resp     = spi_seq_respond(table, seq);
+                resp_len = min(resp->len, xfer->len);
+                req_len  = n; // The first chunk stays in bounce->tx
+                spi_seq_finish(table, seq);
+            }
+        }
+
+        // Response bytes that fall into this chunk, zeros after them
+        memset(bounce->rx, 0, n);
+        if (off < resp_len)
+            spi_seq_copy(table, resp, bounce->tx, req_len, bounce->rx, off, min(n, resp_len - off));
+
+        if (off == 0) {
+            spi_sim_dbg("Command %*ph (length %u): %s\n", min_t(int, n, 64), bounce->tx, xfer->len,
+                        seq ? "matched" : "no matching sequence");
+            trace_spi_sim_transfer(bounce->tx, bounce->rx, n, xfer->speed_hz, seq != NULL);
+            spi_capture(dev, frame->mode, spi_frame_cont(frame), xfer->speed_hz, spi_seq_id(table, seq), bounce->tx,
+                        bounce->rx, xfer->len);
+        }
+
+        if (copy_to_user(rx_user + off, bounce->rx, n)) {
+            spi_sim_err("Failed to copy response to user buffer\n");
+            return -EFAULT;
+        }
+    }
+
+    return xfer->len;
+}
+
+// Full-duplex frame on a kernel buffer, the response replaces the command in place.
+// Used by the shared ring, the caller holds the SRCU read lock for table.
+void spi_transfer_buf(struct spi_sim_file *sf, const struct spi_seq_table *table, u8 *buf, u32 len) {
+    struct spi_sim_dev         *dev = sf->dev;
+    const struct spi_seq_entry *seq = NULL;
+    bool                        capture = spi_capture_enabled(dev);
+    u8                          tx[SPI_SIM_TRACE_DATA];
+    u32                         resp_len = 0;
+
+    spi_stats_inc(dev, transfers);
+    spi_stats_add(dev, bytes_in, len);
+    spi_stats_add(dev, bytes_out, len);
+
+    // The response overwrites the command, keep what the capture records of it
+    if (capture)
+        memcpy(tx, buf, min_t(u32, len, sizeof(tx)));
+
+    if (dev->model) {
+        struct spi_model_frame frame = {0};
+
+        trace_spi_sim_transfer(buf, NULL, len, 0, true);
+        dev->model->xfer(dev, &frame, buf, buf, len);
+        if (dev->model->frame_end)
+            dev->model->frame_end(dev, &frame);
+    } else {
+        seq = spi_seq_lookup(table, buf, len);
+        spi_stats_lookup(dev, seq);
+        trace_spi_sim_transfer(buf, NULL, len, 0, seq != NULL);
+        if (seq) {
+            const struct spi_seq_resp *resp = spi_seq_respond(table, seq);
+            u8                         req[SPI_SEQ_MAX_REF];
+            u32                        req_len = 0;
+
+            // The response replaces the request, keep the bytes it refers to
+            if (resp->nr_refs) {
+                req_len = min_t(u32, len, sizeof(req));
+                memcpy(req, buf, req_len);
+            }
+            resp_len = min(resp->len, len);
+            spi_seq_copy(table, resp, req, req_len, buf, 0, resp_len);
+            spi_seq_finish(table, seq);
+        }
+        memset(buf + resp_len, 0, len - resp_len);
+    }
+
+    if (capture)
+        spi_capture(dev, READ_ONCE(sf->mode), 0, READ_ONCE(sf->max_speed_hz), spi_seq_id(table, seq), tx, buf, len);
+}
+
+// Device model operation, the model sees every byte of the segment chunk by chunk
+static int spi_transfer_model(struct spi_sim_dev *dev, struct spi_frame *frame, const struct spi_ioc_transfer *xfer,
+                              struct spi_bounce *bounce) {
+    const u8 __user *tx_user = u64_to_user_ptr(xfer->tx_buf);
+    u8 __user       *rx_user = u64_to_user_ptr(xfer->rx_buf);
+    u32              off;
+    u32              n;
 
-    u32          mode; // Changed to u32 to match IOCTL definition
-    void __user *argp = (void __user *) arg;
+    for (off = 0; off < xfer->len; off += n) {
+        n = min(xfer->len - off, bounce->size);
+
+        if (tx_user && copy_from_user(bounce->tx, tx_user + off, n)) {
+            spi_sim_err("Failed to copy tx buffer from user\n");
+            return -EFAULT;
+        }
+        dev->model->xfer(dev, &frame->model, tx_user ? bounce->tx : NULL, rx_user ? bounce->rx : NULL, n);
+        if (rx_user && copy_to_user(rx_user + off, bounce->rx, n)) {
+            spi_sim_err("Failed to copy rx buffer to user\n");
+            return -EFAULT;
+        }
+
+        if (off == 0) {
+            trace_spi_sim_transfer(tx_user ? bounce->tx : NULL, rx_user ? bounce->rx : NULL, n, xfer->speed_hz,
+                                   true);
+            spi_capture(dev, frame->mode, spi_frame_cont(frame), xfer->speed_hz, SPI_SIM_TRACE_NO_SEQ,
+                        tx_user ? bounce->tx : NULL, rx_user ? bounce->rx : NULL, xfer->len);
+        }
+    }
+
+    return (tx_user && rx_user) ? xfer->len : 0;
+}
+
+// Chip select goes high, let the model or the last matched sequence finish the frame
+static void spi_frame_end(struct spi_sim_dev *dev, const struct spi_seq_table *table, struct spi_frame *frame) {
+    if (dev->model && dev->model->frame_end && frame->model.pos)
+        dev->model->frame_end(dev, &frame->model);
+    spi_seq_finish(table, frame->seq);
+    spi_frame_reset(frame);
+}
+
+// Run one segment of a SPI message. Returns the transfer length for full-duplex
+// segments, 0 for the others or a negative error code.
+static int spi_transfer_one(struct spi_sim_dev *dev, const struct spi_seq_table *table, struct spi_frame *frame,
+                            const struct spi_ioc_transfer *xfer, struct spi_bounce *bounce) {
+    spi_sim_dbg("Transfer details - tx_buf: %llx, rx_buf: %llx, len: %u, speed_hz: %u, delay_usecs: %u, "
+                "bits_per_word: %u, cs_change: %u\n",
+                (unsigned long long) xfer->tx_buf, (unsigned long long) xfer->rx_buf, xfer->len, xfer->speed_hz,
+                xfer->delay_usecs, xfer->bits_per_word, xfer->cs_change);
+
+    if (!xfer->len)
+        return 0;
+
+    spi_stats_inc(dev, transfers);
+    if (xfer->tx_buf)
+        spi_stats_add(dev, bytes_in, xfer->len);
+    if (xfer->rx_buf)
+        spi_stats_add(dev, bytes_out, xfer->len);
+
+    if (dev->model)
+        return spi_transfer_model(dev, frame, xfer, bounce);
+    if (xfer->tx_buf && !xfer->rx_buf)
+        return spi_transfer_write(dev, table, frame, xfer, bounce);
+    if (!xfer->tx_buf && xfer->rx_buf)
+        return spi_transfer_read(dev, table, frame, xfer, bounce);
+    if (xfer->tx_buf && xfer->rx_buf)
+        return spi_transfer_duplex(dev, table, frame, xfer, bounce);
+    return 0;
+}
+
+// SPI_IOC_MESSAGE(N): copy the whole descriptor array at once and run the segments back-to-back
+// against a single sequence table snapshot. Data moves through bounce buffers of at most
+// SPI_SIM_CHUNK_SIZE bytes (or the longest key), whatever the transfer length.
+static long spi_message(struct spi_sim_file *sf, const void __user *argp, unsigned int n_xfers) {
+    struct spi_ioc_transfer    *xfers;
+    struct spi_frame           *frame  = NULL;
+    struct spi_bounce           bounce = {0};
+    const struct spi_seq_table *table;
+    u32                         max_len = 0;
+    u32                         cmd_cap;
+    u64                         wire_ns = 0;
+    unsigned int                i;
+    int                         srcu_idx;
+    long                        total = 0;
+    int                         ret   = 0;
+
+    if (n_xfers == 0)
+        return 0;
+
+    xfers = memdup_user(argp, n_xfers * sizeof(struct spi_ioc_transfer));
+    if (IS_ERR(xfers)) {
+        spi_sim_err("Failed to copy transfers from user\n");
+        return PTR_ERR(xfers);
+    }
+
+    // Segments without their own speed or word size use the settings of this file
+    for (i = 0; i < n_xfers; i++) {
+        max_len = max(max_len, xfers[i].len);
+        if (!xfers[i].speed_hz)
+            xfers[i].speed_hz = READ_ONCE(sf->max_speed_hz);
+        if (!xfers[i].bits_per_word)
+            xfers[i].bits_per_word = READ_ONCE(sf->bits_per_word);
+
+        // Every chip select frame adds its setup and hold time
+        if (READ_ONCE(spi_timing)) {
+            wire_ns += spi_timing_xfer_ns(&xfers[i]);
+            if (i == 0 || xfers[i - 1].cs_change)
+                wire_ns += READ_ONCE(spi_cs_delay_ns);
+        }
+    }
+
+    srcu_idx = srcu_read_lock(&sequence_srcu);
+    table    = srcu_dereference(sf->dev->table, &sequence_srcu);
+    cmd_cap  = table ? table->max_req_len : 0;
+
+    // A chunk must hold the longest key for full-duplex matching
+    bounce.size = min(max_len, max_t(u32, SPI_SIM_CHUNK_SIZE, cmd_cap));
+    frame       = kzalloc(struct_size(frame, cmd, cmd_cap), GFP_KERNEL);
+    if (bounce.size) {
+        bounce.tx = kvmalloc(bounce.size, GFP_KERNEL);
+        bounce.rx = kvmalloc(bounce.size, GFP_KERNEL);
+    }
+    if (!frame || (bounce.size && (!bounce.tx || !bounce.rx))) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    frame->cmd_cap = cmd_cap;
+    frame->mode    = READ_ONCE(sf->mode);
+    spi_frame_reset(frame);
+
+    for (i = 0; i < n_xfers; i++) {
+        ret = spi_transfer_one(sf->dev, table, frame, &xfers[i], &bounce);
+        if (ret < 0)
+            break;
+        total += ret;
+        frame->segs++;
+
+        // Chip select is released between segments, the next segment starts a new frame
+        if (xfers[i].cs_change)
+            spi_frame_end(sf->dev, table, frame);
+    }
+    spi_frame_end(sf->dev, table, frame);
+
+out:
+    srcu_read_unlock(&sequence_srcu, srcu_idx);
+    kvfree(bounce.tx);
+    kvfree(bounce.rx);
+    kfree(frame);
+    kfree(xfers);
+
+    // Timing mode, return once the message has been on the bus
+    if (ret >= 0)
+        spi_bus_occupy(sf->dev->bus, wire_ns);
+    return ret < 0 ? ret : total;
+}
+
+static long spi_ioctl_cmd(struct file *file, unsigned int cmd, unsigned long arg) {
+    spi_sim_dbg("IOCTL command received: %u (0x%x)\n", cmd, cmd);
+
+    struct spi_sim_file *sf   = file->private_data;
+    void __user         *argp = (void __user *) arg;
+
+    // IOCTL Read/Write SPI Message, any number of transfers
+    if (_IOC_TYPE(cmd) == SPI_IOC_MAGIC && _IOC_NR(cmd) == _IOC_NR(SPI_IOC_MESSAGE(0)) &&
+        _IOC_DIR(cmd) == _IOC_WRITE) {
+        if (_IOC_SIZE(cmd) % sizeof(struct spi_ioc_transfer)) {
+            spi_sim_err("Invalid SPI message size: %u\n", _IOC_SIZE(cmd));
+            return -EINVAL;
+        }
+        return spi_message(sf, argp, _IOC_SIZE(cmd) / sizeof(struct spi_ioc_transfer));
+    }
 
     switch (cmd) {
         // IOCTL Write SPI Mode
         case SPI_IOC_WR_MODE: {
-            printk(KERN_INFO "SPI Simulator: Setting SPI mode\n");
+            u8 mode;
+            spi_sim_dbg("Setting SPI mode\n");
             if (copy_from_user(&mode, argp, sizeof(mode))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy mode from user\n");
+                spi_sim_err("Failed to copy mode from user\n");
                 return -EFAULT;
             }
             if (mode > 3) {
-                printk(KERN_ERR "SPI Simulator: Invalid mode value: %u\n", mode);
+                spi_sim_err("Invalid mode value: %u\n", mode);
                 return -EINVAL;
             }
-            spi_mode = mode;
-            printk(KERN_INFO "SPI Simulator: Mode successfully set to %u\n", mode);
+            WRITE_ONCE(sf->mode, (READ_ONCE(sf->mode) & SPI_LSB_FIRST) | mode);
+            spi_sim_info("Mode successfully set to %u\n", mode);
             return 0;
         }
 
         // IOCTL Read SPI Mode
         case SPI_IOC_RD_MODE: {
-            printk(KERN_INFO "SPI Simulator: Getting SPI mode\n");
-            if (copy_to_user(argp, &spi_mode, sizeof(spi_mode))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy mode to user\n");
+            u8 mode = READ_ONCE(sf->mode);
+            spi_sim_dbg("Getting SPI mode\n");
+            if (copy_to_user(argp, &mode, sizeof(mode))) {
+                spi_sim_err("Failed to copy mode to user\n");
                 return -EFAULT;
             }
-            printk(KERN_INFO "SPI Simulator: Mode successfully read as %d\n", spi_mode);
+            spi_sim_dbg("Mode successfully read as %u\n", mode);
             return 0;
         }
 
         // IOCTL Write SPI Bits Per Word
         case SPI_IOC_WR_BITS_PER_WORD: {
             u8 bits;
-            printk(KERN_INFO "SPI Simulator: Setting SPI bits per word\n");
+            spi_sim_dbg("Setting SPI bits per word\n");
             if (copy_from_user(&bits, argp, sizeof(bits))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy bits from user\n");
+                spi_sim_err("Failed to copy bits from user\n");
                 return -EFAULT;
             }
             if (bits < 1 || bits > 32) {
-                printk(KERN_ERR "SPI Simulator: Invalid bits per word value: %u\n", bits);
+                spi_sim_err("Invalid bits per word value: %u\n", bits);
                 return -EINVAL;
             }
-            // Here you would typically set the bits per word in your SPI device
-            printk(KERN_INFO "SPI Simulator: Bits per word successfully set to %u\n", bits);
+            WRITE_ONCE(sf->bits_per_word, bits);
+            spi_sim_info("Bits per word successfully set to %u\n", bits);
             return 0;
         }
         // IOCTL Read SPI Bits Per Word
         case SPI_IOC_RD_BITS_PER_WORD: {
-            u8 bits = 8; // Default bits per word
-            printk(KERN_INFO "SPI Simulator: Getting SPI bits per word\n");
+            u8 bits = READ_ONCE(sf->bits_per_word);
+            spi_sim_dbg("Getting SPI bits per word\n");
             if (copy_to_user(argp, &bits, sizeof(bits))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy bits to user\n");
+                spi_sim_err("Failed to copy bits to user\n");
                 return -EFAULT;
             }
-            printk(KERN_INFO "SPI Simulator: Bits per word successfully read as %u\n", bits);
+            spi_sim_dbg("Bits per word successfully read as %u\n", bits);
             return 0;
         }
 
         // IOCTL Write SPI Max Speed
         case SPI_IOC_WR_MAX_SPEED_HZ: {
             u32 speed;
-            printk(KERN_INFO "SPI Simulator: Setting SPI max speed\n");
+            spi_sim_dbg("Setting SPI max speed\n");
             if (copy_from_user(&speed, argp, sizeof(speed))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy speed from user\n");
+                spi_sim_err("Failed to copy speed from user\n");
                 return -EFAULT;
             }
             if (speed == 0) {
-                printk(KERN_ERR "SPI Simulator: Invalid speed value: %u\n", speed);
+                spi_sim_err("Invalid speed value: %u\n", speed);
                 return -EINVAL;
             }
-            // Here you would typically set the max speed in your SPI device
-            printk(KERN_INFO "SPI Simulator: Max speed successfully set to %u Hz\n", speed);
+            WRITE_ONCE(sf->max_speed_hz, speed);
+            spi_sim_info("Max speed successfully set to %u Hz\n", speed);
             return 0;
         }
         // IOCTL Read SPI Max Speed
         case SPI_IOC_RD_MAX_SPEED_HZ: {
-            u32 speed = 500000; // Default max speed
-            printk(KERN_INFO "SPI Simulator: Getting SPI max speed\n");
+            u32 speed = READ_ONCE(sf->max_speed_hz);
+            spi_sim_dbg("Getting SPI max speed\n");
             if (copy_to_user(argp, &speed, sizeof(speed))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy speed to user\n");
+                spi_sim_err("Failed to copy speed to user\n");
                 return -EFAULT;
             }
-            printk(KERN_INFO "SPI Simulator: Max speed successfully read as %u Hz\n", speed);
+            spi_sim_dbg("Max speed successfully read as %u Hz\n", speed);
             return 0;
         }
         // IOCTL Write SPI LSB First
         case SPI_IOC_WR_LSB_FIRST: {
             u8 lsb_first;
-            printk(KERN_INFO "SPI Simulator: Setting SPI LSB first\n");
+            spi_sim_dbg("Setting SPI LSB first\n");
             if (copy_from_user(&lsb_first, argp, sizeof(lsb_first))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy LSB first from user\n");
+                spi_sim_err("Failed to copy LSB first from user\n");
                 return -EFAULT;
             }
-            // Here you would typically set the LSB first in your SPI device
-            printk(KERN_INFO "SPI Simulator: LSB first successfully set to %u\n", lsb_first);
+            if (lsb_first) {
+                WRITE_ONCE(sf->mode, READ_ONCE(sf->mode) | SPI_LSB_FIRST);
+            } else {
+                WRITE_ONCE(sf->mode, READ_ONCE(sf->mode) & ~SPI_LSB_FIRST);
+            }
+            spi_sim_info("LSB first successfully set to %u\n", lsb_first);
             return 0;
         }
         // IOCTL Read SPI LSB First
         case SPI_IOC_RD_LSB_FIRST: {
-            u8 lsb_first = 0; // Default LSB first
-            printk(KERN_INFO "SPI Simulator: Getting SPI LSB first\n");
+            u8 lsb_first = (READ_ONCE(sf->mode) & SPI_LSB_FIRST) ? 1 : 0;
+            spi_sim_dbg("Getting SPI LSB first\n");
             if (copy_to_user(argp, &lsb_first, sizeof(lsb_first))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy LSB first to user\n");
+                spi_sim_err("Failed to copy LSB first to user\n");
                 return -EFAULT;
             }
-            printk(KERN_INFO "SPI Simulator: LSB first successfully read as %u\n", lsb_first);
+            spi_sim_dbg("LSB first successfully read as %u\n", lsb_first);
             return 0;
         }
         // IOCTL Write SPI Mode 32
         case SPI_IOC_WR_MODE32: {
             u32 mode32;
-            printk(KERN_INFO "SPI Simulator: Setting SPI mode 32\n");
+            spi_sim_dbg("Setting SPI mode 32\n");
             if (copy_from_user(&mode32, argp, sizeof(mode32))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy mode 32 from user\n");
+                spi_sim_err("Failed to copy mode 32 from user\n");
                 return -EFAULT;
             }
             if (mode32 > 3) {
-                printk(KERN_ERR "SPI Simulator: Invalid mode 32 value: %u\n", mode32);
+                spi_sim_err("Invalid mode 32 value: %u\n", mode32);
                 return -EINVAL;
             }
-            spi_mode = mode32;
-            printk(KERN_INFO "SPI Simulator: Mode 32 successfully set to %u\n", mode32);
+            WRITE_ONCE(sf->mode, (READ_ONCE(sf->mode) & SPI_LSB_FIRST) | mode32);
+            spi_sim_info("Mode 32 successfully set to %u\n", mode32);
             return 0;
         }
         // IOCTL Read SPI Mode 32
         case SPI_IOC_RD_MODE32: {
-            u32 mode32 = spi_mode; // Use current mode
-            printk(KERN_INFO "SPI Simulator: Getting SPI mode 32\n");
+            u32 mode32 = READ_ONCE(sf->mode);
+            spi_sim_dbg("Getting SPI mode 32\n");
             if (copy_to_user(argp, &mode32, sizeof(mode32))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy mode 32 to user\n");
+                spi_sim_err("Failed to copy mode 32 to user\n");
                 return -EFAULT;
             }
-            printk(KERN_INFO "SPI Simulator: Mode 32 successfully read as %u\n", mode32);
+            spi_sim_dbg("Mode 32 successfully read as %u\n", mode32);
             return 0;
         }
 
-
-        // IOCTL Read/WriteSPI Message
-        case SPI_IOC_MESSAGE(1): {
-            struct spi_ioc_transfer transfer;
-            printk(KERN_INFO "SPI Simulator: Handling SPI message\n");
-
-            if (copy_from_user(&transfer, argp, sizeof(transfer))) {
-                printk(KERN_ERR "SPI Simulator: Failed to copy transfer from user\n");
+        // IOCTL Shared ring setup and doorbell
+        case SPI_SIM_IOC_RING_SETUP:
+            return spi_ring_setup(sf, argp);
+        case SPI_SIM_IOC_RING_ENTER:
+            return spi_ring_enter(sf);
+
+        // IOCTL Reload the sequence table without reloading the module
+        case SPI_SIM_IOC_RELOAD: {
+            struct spi_sim_reload reload;
+            int                   ret;
+            // The table is shared by every user of the device and an image is adopted as is
+            if (!capable(CAP_SYS_ADMIN))
+                return -EPERM;
+            spi_sim_info("Reloading sequences\n");
+            if (copy_from_user(&reload, argp, sizeof(reload))) {
+                spi_sim_err("Failed to copy reload request from user\n");
                 return -EFAULT;
             }
-
-            printk(KERN_INFO "SPI Simulator: Transfer details - tx_buf: %llx, rx_buf: %llx, len: %u, speed_hz: %u, "
-                             "delay_usecs: %u, bits_per_word: %u\n",
-                   (unsigned long long) transfer.tx_buf, (unsigned long long) transfer.rx_buf, transfer.len,
-                   transfer.speed_hz, transfer.delay_usecs, transfer.bits_per_word);
-
-            // Check if this is a read or write operation based on tx_buf and rx_buf
-            if (transfer.tx_buf && !transfer.rx_buf) {
-                printk(KERN_INFO "SPI Simulator: Write operation detected\n");
-
-                // Handle write operation
-                if (transfer.len > 0 && transfer.tx_buf) {
-                    u8 *tx_buf = kmalloc(transfer.len, GFP_KERNEL);
-                    if (!tx_buf) {
-                        return -ENOMEM;
-                    }
-
-                    if (copy_from_user(tx_buf, (const void __user *) transfer.tx_buf, transfer.len)) {
-                        kfree(tx_buf);
-                        return -EFAULT;
-                    }
-
-                    // Process the write data
-                    printk(KERN_INFO "SPI Simulator: Writing %d bytes\n", transfer.len);
-                    printk(KERN_INFO "SPI Simulator: Data: ");
-                    for (unsigned int i = 0; i < transfer.len; i++) {
-                        printk(KERN_CONT "0x%02x ", tx_buf[i]);
-                    }
-                    printk(KERN_CONT "\n");
-
-                    kfree(tx_buf);
-                }
-            } else if (!transfer.tx_buf && transfer.rx_buf) {
-                printk(KERN_INFO "SPI Simulator: Read operation detected\n");
-                // Handle read operation
-                if (transfer.len > 0 && transfer.rx_buf) {
-                    u8 *rx_buf = kmalloc(transfer.len, GFP_KERNEL);
-                    if (!rx_buf) {
-                        return -ENOMEM;
-                    }
-
-                    // Simulate reading data (fill with dummy data)
-                    memset(rx_buf, 0xAA, transfer.len);
-
-                    if (copy_to_user((void __user *) transfer.rx_buf, rx_buf, transfer.len)) {
-                        kfree(rx_buf);
-                        return -EFAULT;
-                    }
-
-                    printk(KERN_INFO "SPI Simulator: Reading %d bytes\n", transfer.len);
-                    printk(KERN_INFO "SPI Simulator: Data: ");
-                    for (unsigned int i = 0; i < transfer.len; i++) {
-                        printk(KERN_CONT "0x%02x ", rx_buf[i]);
-                    }
-                    printk(KERN_CONT "\n");
-
-                    kfree(rx_buf);
-                }
-            } else if (transfer.tx_buf && transfer.rx_buf) {
-                printk(KERN_INFO "SPI Simulator: Full-duplex operation detected\n");
-
-                // Handle full-duplex operation
-                if (transfer.len > 0 && transfer.tx_buf) {
-                    // Validate transfer length
-                    if (transfer.len > 256) {
-                        printk(KERN_ERR "SPI Simulator: Transfer length too large: %u\n", transfer.len);
-                        return -EINVAL;
-                    }
-
-                    // Calculate actual tx buffer size by finding first null byte
-                    __u32 actual_len = 0;
-                    u8   *temp_buf   = kmalloc(transfer.len, GFP_KERNEL);
-                    if (!temp_buf) {
-                        return -ENOMEM;
-                    }
-
-                    if (copy_from_user(temp_buf, (const void __user *) transfer.tx_buf, transfer.len)) {
-                        kfree(temp_buf);
-                        return -EFAULT;
-                    }
-
-                    // Find actual length by looking for first null byte or non-zero byte
-                    while (actual_len < transfer.len && temp_buf[actual_len] != 0) {
-                        actual_len++;
-                    }
-                    kfree(temp_buf);
-
-                    printk(KERN_INFO "SPI Simulator: Transfer length: %u, Actual length: %u\n", transfer.len,
-                           actual_len);
-
-                    // Validate actual length
-                    if (actual_len == 0) {
-                        printk(KERN_ERR "SPI Simulator: No valid data found in transfer\n");
-                        return -EINVAL;
-                    }
-
-                    // Allocate buffer for actual data
-                    u8 *tx_buf = kmalloc(actual_len, GFP_KERNEL);
-                    if (!tx_buf) {
-                        return -ENOMEM;
-                    }
-
-                    if (copy_from_user(tx_buf, (const void __user *) transfer.tx_buf, actual_len)) {
-                        kfree(tx_buf);
-                        return -EFAULT;
-                    }
-
-                    // Convert tx_buf to string for sequence matching
-                    char cmd[256] = {0};
-                    int  i;
-                    for (i = 0; i < actual_len && i < sizeof(cmd) - 1; i++) {
-                        snprintf(cmd + (i * 3), 4, "%02X ", tx_buf[i]);
-                    }
-                    if (i > 0) {
-                        cmd[(i * 3) - 1] = '\0'; // Remove trailing space
-                    }
-
-                    printk(KERN_INFO "SPI Simulator: Received command: %s\n", cmd);
-
-                    // Search in sequence list
-                    struct spi_sequence *seq;
-                    bool                 found         = false;
-                    char                 response[256] = {0};
-
-                    printk(KERN_INFO "SPI Simulator: Searching for sequence match...\n");
-                    printk(KERN_INFO "SPI Simulator: Looking for command: '%s'\n", cmd);
-
-                    mutex_lock(&sequence_mutex);
-                    list_for_each_entry(seq, &sequence_list, list) {
-                        printk(KERN_INFO "SPI Simulator: Comparing with sequence - Received: '%s', Response: '%s'\n",
-                               seq->received, seq->response);
-
-                        // Trim whitespace and convert to uppercase for case-insensitive comparison
-                        char trimmed_cmd[256]      = {0};
-                        char trimmed_received[256] = {0};
-                        int  i, j;
-
-                        // Trim and convert cmd to uppercase
-                        for (i = 0, j = 0; cmd[i]; i++) {
-                            if (cmd[i] != ' ') {
-                                trimmed_cmd[j] = toupper(cmd[i]);
-                                j++;
-                            }
-                        }
-                        trimmed_cmd[j] = '\0';
-
-                        // Trim and convert received to uppercase
-                        for (i = 0, j = 0; seq->received[i]; i++) {
-                            if (seq->received[i] != ' ') {
-                                trimmed_received[j] = toupper(seq->received[i]);
-                                j++;
-                            }
-                        }
-                        trimmed_received[j] = '\0';
-
-                        printk(KERN_INFO
-                               "SPI Simulator: Trimmed and uppercase comparison - Command: '%s', Sequence: '%s'\n",
-                               trimmed_cmd, trimmed_received);
-
-                        if (strcmp(trimmed_cmd, trimmed_received) == 0) {
-                            strncpy(response, seq->response, sizeof(response) - 1);
-                            found = true;
-                            printk(KERN_INFO "SPI Simulator: Found matching sequence!\n");
-                            break;
-                        }
-                    }
-                    mutex_unlock(&sequence_mutex);
-
-                    if (!found) {
-                        // Default response if no sequence matches
-                        snprintf(response, sizeof(response), "Unknown command: %s", cmd);
-                        printk(KERN_INFO "SPI Simulator: No matching sequence found\n");
-                    }
-
-                    // Convert response string to bytes
-                    u8 *rx_buf = kmalloc(transfer.len, GFP_KERNEL);
-                    if (!rx_buf) {
-                        kfree(tx_buf);
-                        return -EFAULT;
-                    }
-
-                    // Initialize rx_buf with zeros
-                    memset(rx_buf, 0, transfer.len);
-
-                    if (found) {
-                        // Parse hex string to bytes using kernel functions
-                        char *ptr = response;
-                        int   idx = 0;
-
-                        printk(KERN_INFO "SPI Simulator: Converting response: '%s'\n", response);
-
-                        while (*ptr && idx < actual_len) {
-                            char hex[3] = {0};
-                            int  i      = 0;
-
-                            // Skip spaces
-                            while (*ptr && *ptr == ' ')
-                                ptr++;
-                            if (!*ptr)
-                                break;
-
-                            // Get next two characters
-                            while (*ptr && *ptr != ' ' && i < 2) {
-                                hex[i++] = *ptr++;
-                            }
-
-                            // Convert hex to byte
-                            long val;
-                            if (kstrtol(hex, 16, &val) == 0) {
-                                rx_buf[idx++] = (u8) val;
-                                printk(KERN_INFO "SPI Simulator: Converted hex '%s' to byte 0x%02X\n", hex, (u8) val);
-                            }
-                        }
-                    }
-
-                    // Log the final response buffer
-                    printk(KERN_INFO "SPI Simulator: Final response buffer (length %u): ", transfer.len);
-                    for (int i = 0; i < transfer.len; i++) {
-                        printk(KERN_CONT "0x%02X ", rx_buf[i]);
-                    }
-                    printk(KERN_CONT "\n");
-
-                    printk(KERN_INFO "SPI Simulator: About to copy %u bytes to user buffer at %llx\n", transfer.len,
-                           (unsigned long long) transfer.rx_buf);
-
-                    // Copy response to user buffer
-                    if (copy_to_user((void __user *) transfer.rx_buf, rx_buf, transfer.len)) {
-                        printk(KERN_ERR "SPI Simulator: Failed to copy response to user buffer\n");
-                        kfree(tx_buf);
-                        kfree(rx_buf);
-                        return -EFAULT;
-                    }
-
-                    printk(KERN_INFO "SPI Simulator: Successfully copied response to user buffer\n");
-
-                    kfree(tx_buf);
-                    kfree(rx_buf);
-                    return actual_len; // Return actual length instead of transfer length
-                }
+            ret = reload_sequences(sf->dev, u64_to_user_ptr(reload.buf), reload.len, reload.flags);
+            if (ret) {
+                spi_sim_err("Failed to reload sequences: %d\n", ret);
+                return ret;
             }
-
-            printk(KERN_INFO "SPI Simulator: SPI transfer completed with length %u\n", transfer.len);
+            spi_sim_info("Sequences successfully reloaded\n");
             return 0;
         }
 
         default:
-            printk(KERN_ERR "SPI Simulator: Invalid IOCTL command.\n");
+            spi_sim_err("Invalid IOCTL command.\n");
             return -ENOTTY;
     }
 }
+
+// Every ioctl is timed into the latency histogram of the device
+long spi_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    struct spi_sim_file *sf    = file->private_data;
+    u64                  start = ktime_get_ns();
+    long                 ret;
+
+    ret = spi_ioctl_cmd(file, cmd, arg);
+    if (ret < 0)
+        spi_stats_inc(sf->dev, ioctl_errors);
+    spi_stats_latency(sf->dev, ktime_get_ns() - start);
+    return ret;
+}
+
+#ifdef SPI_SIM_URING_CMD
+// IORING_OP_URING_CMD: run a SPI message without a blocking ioctl. The message is an in-memory
+// operation, so it completes inline and the result becomes the completion of the request.
+int spi_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags) {
+    const struct spi_sim_uring_msg *msg = io_uring_sqe_cmd(ioucmd->sqe);
+    struct spi_sim_file            *sf  = ioucmd->file->private_data;
+    u64                             xfers;
+    u32                             n_xfers;
+
+    if (ioucmd->cmd_op != SPI_SIM_URING_MESSAGE)
+        return -ENOTTY;
+
+    // The SQE stays in shared memory, read each field once
+    xfers   = READ_ONCE(msg->xfers);
+    n_xfers = READ_ONCE(msg->n_xfers);
+    if (n_xfers > SPI_SIM_MAX_XFERS)
+        return -EINVAL;
+
+    // Timing mode sleeps, so run from the io_uring worker instead of the submitting task
+    if (READ_ONCE(spi_timing) && (issue_flags & IO_URING_F_NONBLOCK))
+        return -EAGAIN;
+
+    return spi_message(sf, u64_to_user_ptr(xfers), n_xfers);
+}
+#endif
@@ -0,0 +1,1108 @@
+// Sequence parser, compiled table and matcher. Kernel independent, the driver uses it through
+// spi_sequence_match.c and the same file builds as the userspace library spi_seq_core.
+#include "spi_seq_core.h"
+
+// FNV-1a over the raw request bytes
+static u32 spi_seq_hash(const u8 *data, u32 len) {
+    u32 hash = 2166136261u;
+
+    while (len--) {
+        hash ^= *data++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Decode a hex string like "9F 01" or "9f01" into bytes.
+// Space separated tokens with a single digit become one byte, longer tokens are read in pairs.
+static int spi_seq_decode_hex(const char *str, u32 str_len, u8 *out, u32 max_len) {
+    const char *end = str + str_len;
+    u32         len = 0;
+
+    while (str < end) {
+        const char *tok;
+        int         tok_len;
+
+        while (str < end && *str == ' ')
+            str++;
+        if (str == end)
+            break;
+
+        tok = str;
+        while (str < end && *str != ' ')
+            str++;
+        tok_len = str - tok;
+
+        while (tok_len > 0) {
+            int digits = (tok_len % 2) ? 1 : 2;
+            int hi     = 0;
+            int lo;
+
+            if (len >= max_len)
+                return -E2BIG;
+            if (digits == 2)
+                hi = hex_to_bin(*tok++);
+            lo = hex_to_bin(*tok++);
+            if (hi < 0 || lo < 0)
+                return -EINVAL;
+
+            out[len++] = (hi << 4) | lo;
+            tok_len -= digits;
+        }
+    }
+    return len;
+}
+
+// One byte written with one or two hex digits
+static int spi_seq_decode_byte(const char *str, u32 len) {
+    int hi = 0;
+    int lo;
+
+    if (len != 1 && len != 2)
+        return -EINVAL;
+    if (len == 2)
+        hi = hex_to_bin(*str++);
+    lo = hex_to_bin(*str);
+    return (hi < 0 || lo < 0) ? -EINVAL : (hi << 4) | lo;
+}
+
+// Hex digit of a request pattern, "?" matches any nibble
+static int spi_seq_pattern_digit(char c, u8 *val, u8 *mask) {
+    int digit;
+
+    if (c == '?') {
+        *val  = 0;
+        *mask = 0;
+        return 0;
+    }
+    digit = hex_to_bin(c);
+    if (digit < 0)
+        return -EINVAL;
+    *val  = digit;
+    *mask = 0xF;
+    return 0;
+}
+
+// Decode a request like "03 ?? ?? ??" or "80/80 1?" into values and masks, a zero mask bit matches
+// any request bit. Tokens are read like spi_seq_decode_hex, "?" is a wildcard digit (a lone "?" a
+// wildcard byte) and "value/mask" keeps only the mask bits of the value.
+static int spi_seq_decode_pattern(const char *str, u32 str_len, u8 *val, u8 *mask, u32 max_len) {
+    const char *end = str + str_len;
+    u32         len = 0;
+
+    while (str < end) {
+        const char *tok;
+        const char *slash;
+        int         tok_len;
+
+        while (str < end && *str == ' ')
+            str++;
+        if (str == end)
+            break;
+
+        tok = str;
+        while (str < end && *str != ' ')
+            str++;
+        tok_len = str - tok;
+
+        slash = memchr(tok, '/', tok_len);
+        if (slash) {
+            int v = spi_seq_decode_byte(tok, slash - tok);
+            int m = spi_seq_decode_byte(slash + 1, str - slash - 1);
+
+            if (len >= max_len)
+                return -E2BIG;
+            if (v < 0 || m < 0)
+                return -EINVAL;
+            val[len]    = v & m;
+            mask[len++] = m;
+            continue;
+        }
+
+        while (tok_len > 0) {
+            int digits = (tok_len % 2) ? 1 : 2;
+            u8  hi     = 0;
+            u8  hi_mask;
+            u8  lo;
+            u8  lo_mask;
+
+            if (len >= max_len)
+                return -E2BIG;
+            hi_mask = (digits == 1 && *tok == '?') ? 0 : 0xF;
+            if (digits == 2 && spi_seq_pattern_digit(*tok++, &hi, &hi_mask))
+                return -EINVAL;
+            if (spi_seq_pattern_digit(*tok++, &lo, &lo_mask))
+                return -EINVAL;
+
+            val[len]    = (hi << 4) | lo;
+            mask[len++] = (hi_mask << 4) | lo_mask;
+            tok_len -= digits;
+        }
+    }
+    return len;
+}
+
+// Decode a response like "$1 $2 $3 AA", "$n" is byte n of the request. The referenced bytes are
+// left zero and listed in refs.
+static int spi_seq_decode_response(const char *str, u32 str_len, u8 *out, u32 max_len, struct spi_seq_ref *refs,
+                                   u32 *nr_refs) {
+    const char *end = str + str_len;
+    u32         len = 0;
+    int         ret;
+
+    while (str < end) {
+        const char *tok;
+        u32         req = 0;
+
+        while (str < end && *str == ' ')
+            str++;
+        if (str == end)
+            break;
+
+        tok = str;
+        while (str < end && *str != ' ')
+            str++;
+
+        if (*tok != '$') {
+            ret = spi_seq_decode_hex(tok, str - tok, out + len, max_len - len);
+            if (ret < 0)
+                return ret;
+            len += ret;
+            continue;
+        }
+
+        if (++tok == str)
+            return -EINVAL;
+        for (; tok < str; tok++) {
+            if (!isdigit(*tok))
+                return -EINVAL;
+            req = req * 10 + (*tok - '0');
+            if (req >= SPI_SEQ_MAX_REF)
+                return -ERANGE;
+        }
+        if (len >= max_len)
+            return -E2BIG;
+        refs[*nr_refs].pos = len;
+        refs[*nr_refs].req = req;
+        (*nr_refs)++;
+        out[len++] = 0;
+    }
+    return len;
+}
+
+// Check one key length of the request. Entries keyed on the same bytes keep the file order,
+// an entry of the current state comes before the entries of any state.
+static const struct spi_seq_entry *spi_seq_lookup_key(const struct spi_seq_table *table, const u8 *req, u32 key_len,
+                                                      u32 hash, u32 len, u32 state) {
+    const struct spi_seq_entry *entry;
+    const struct spi_seq_entry *any = NULL;
+    u32                         idx;
+
+    for (idx = table->buckets[hash & (table->nr_buckets - 1)]; idx != SPI_SEQ_NONE; idx = entry->next) {
+        entry = &table->entries[idx];
+        if (entry->hash != hash || entry->req_len != key_len ||
+            memcmp(table->data + entry->req_off, req, key_len) != 0)
+            continue;
+        if (!((entry->flags & SPI_SEQ_EXACT) ? len == entry->min_len : len >= entry->min_len))
+            continue;
+        if (entry->state == state)
+            return entry;
+        if (entry->state == SPI_SEQ_NONE && !any)
+            any = entry;
+    }
+    return any;
+}
+
+// Match the patterns, every request byte narrows the candidates with one bitmap AND. A pattern
+// replaces best when its key is longer, or as long and of the current state while best is not.
+static const struct spi_seq_entry *spi_seq_lookup_pattern(const struct spi_seq_table *table, const u8 *req, u32 len,
+                                                          u32 state, const struct spi_seq_entry *best) {
+    DECLARE_BITMAP(cand, SPI_SEQ_MAX_PATTERNS);
+    u32 words = BITS_TO_LONGS(table->nr_patterns);
+    u32 n     = min(len, table->pattern_len);
+    u32 bit;
+    u32 pos;
+    u32 w;
+
+    bitmap_fill(cand, table->nr_patterns);
+    for (pos = 0; pos < n; pos++) {
+        const unsigned long *bits = table->pattern_bits + ((size_t) pos * 256 + req[pos]) * words;
+        unsigned long        any  = 0;
+
+        for (w = 0; w < words; w++)
+            any |= cand[w] &= bits[w];
+        if (!any)
+            return best;
+    }
+
+    for_each_set_bit(bit, cand, table->nr_patterns) {
+        const struct spi_seq_entry *entry = &table->entries[table->patterns[bit]];
+
+        if (!((entry->flags & SPI_SEQ_EXACT) ? len == entry->min_len : len >= entry->min_len))
+            continue;
+        if (entry->state != SPI_SEQ_NONE && entry->state != state)
+            continue;
+        if (!best || entry->req_len > best->req_len ||
+            (entry->req_len == best->req_len && entry->state == state && best->state != state))
+            best = entry;
+    }
+    return best;
+}
+
+// Find the sequence for a transfer of len bytes. Every key length of the table is tried from
+// the shortest up, extending one running hash, and the longest matching key wins. Patterns
+// are checked last, a plain key wins over a pattern of the same length.
+// Only the first min(len, max_req_len) bytes of req are read.
+const struct spi_seq_entry *spi_seq_lookup(const struct spi_seq_table *table, const u8 *req, u32 len) {
+    const struct spi_seq_entry *best = NULL;
+    const struct spi_seq_entry *entry;
+    u32                         hash     = 2166136261u;
+    u32                         hash_len = 0;
+    u32                         state;
+    u32                         k;
+
+    if (!table || !table->nr_entries || !len)
+        return NULL;
+
+    state = (u32) atomic_read(table->state) & SPI_SEQ_STATE_MASK;
+
+    for (k = 0; k < table->nr_key_lens && table->key_lens[k] <= len; k++) {
+        u32 key_len = table->key_lens[k];
+
+        for (; hash_len < key_len; hash_len++) {
+            hash ^= req[hash_len];
+            hash *= 16777619u;
+        }
+        entry = spi_seq_lookup_key(table, req, key_len, hash, len, state);
+        if (entry)
+            best = entry;
+    }
+
+    if (table->nr_patterns)
+        best = spi_seq_lookup_pattern(table, req, len, state, best);
+    return best;
+}
+
+// Move to a new state, a change starts a new visit
+static void spi_seq_enter(const struct spi_seq_table *table, u32 state) {
+    u32 old;
+
+    if (state == SPI_SEQ_NONE)
+        return;
+
+    do {
+        old = atomic_read(table->state);
+        if ((old & SPI_SEQ_STATE_MASK) == state)
+            return;
+    } while ((u32) atomic_cmpxchg(table->state, old, (((old >> 16) + 1) << 16) | state) != old);
+}
+
+// Response of a matched entry. Entries with several responses give the next one on every call
+// and keep answering with the last. The list starts over on every visit to the state of the entry.
+const struct spi_seq_resp *spi_seq_respond(const struct spi_seq_table *table, const struct spi_seq_entry *entry) {
+    const struct spi_seq_resp *resp = &table->resps[entry->resp];
+
+    if (entry->nr_resps > 1) {
+        atomic_t *cursor = &table->cursors[entry - table->entries];
+        u32       visit  = entry->state == SPI_SEQ_NONE ? 0 : (u32) atomic_read(table->state) >> 16;
+        u32       old;
+        u32       idx;
+
+        do {
+            old = atomic_read(cursor);
+            idx = (old >> 16) == visit ? old & SPI_SEQ_STATE_MASK : 0;
+        } while ((u32) atomic_cmpxchg(cursor, old, (visit << 16) | min(idx + 1, entry->nr_resps - 1)) != old);
+        resp += idx;
+    }
+
+    spi_seq_enter(table, resp->next_state);
+    return resp;
+}
+
+// Copy len response bytes from offset off, filling in the referenced bytes of the request.
+// References past req_len read as zero.
+void spi_seq_copy(const struct spi_seq_table *table, const struct spi_seq_resp *resp, const u8 *req, u32 req_len,
+                  u8 *out, u32 off, u32 len) {
+    const struct spi_seq_ref *ref = &table->refs[resp->ref];
+    u32                       i;
+
+    memcpy(out, table->data + resp->off + off, len);
+    for (i = 0; i < resp->nr_refs; i++, ref++) {
+        if (ref->pos >= off && ref->pos - off < len)
+            out[ref->pos - off] = ref->req < req_len ? req[ref->req] : 0;
+    }
+}
+
+// The command of entry is complete, chip select went high
+void spi_seq_finish(const struct spi_seq_table *table, const struct spi_seq_entry *entry) {
+    if (entry)
+        spi_seq_enter(table, entry->next_state);
+}
+
+// An entry with the same key and the same length rule is already in the table
+static bool spi_seq_duplicate(const struct spi_seq_table *table, const struct spi_seq_entry *new) {
+    const struct spi_seq_entry *entry;
+    u32                         idx;
+
+    for (idx = table->buckets[new->hash & (table->nr_buckets - 1)]; idx != SPI_SEQ_NONE; idx = entry->next) {
+        entry = &table->entries[idx];
+        if (entry->hash == new->hash && entry->req_len == new->req_len && entry->min_len == new->min_len &&
+            entry->flags == new->flags && entry->state == new->state &&
+            memcmp(table->data + entry->req_off, table->data + new->req_off, new->req_len) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Insert a key length into the sorted list of distinct key lengths
+static void spi_seq_add_key_len(struct spi_seq_table *table, u32 key_len) {
+    u32 k = table->nr_key_lens;
+
+    while (k > 0 && table->key_lens[k - 1] > key_len)
+        k--;
+    if (k > 0 && table->key_lens[k - 1] == key_len)
+        return;
+
+    memmove(&table->key_lens[k + 1], &table->key_lens[k], (table->nr_key_lens - k) * sizeof(u32));
+    table->key_lens[k] = key_len;
+    table->nr_key_lens++;
+}
+
+// State names seen while compiling, the position is the state number
+struct spi_seq_states {
+    const char **names;
+    u32         *lens;
+    u32          nr;
+};
+
+// Number of a state name, new names are added
+static int spi_seq_state(struct spi_seq_states *states, const char *name, u32 len) {
+    u32 i;
+
+    for (i = 0; i < states->nr; i++) {
+        if (states->lens[i] == len && !memcmp(states->names[i], name, len))
+            return i;
+    }
+    if (states->nr == SPI_SEQ_MAX_STATES)
+        return -E2BIG;
+
+    states->names[states->nr] = name;
+    states->lens[states->nr]  = len;
+    return states->nr++;
+}
+
+static int spi_seq_decode_responses(struct spi_seq_table *table, struct spi_seq_states *states,
+                                    const struct spi_sequence *seq, struct spi_seq_entry *entry, u32 *data_len,
+                                    u32 data_size);
+
+// Decode the request of a sequence into entry. Trailing wildcard bytes only add to the length, a
+// request with other wildcard or masked bytes becomes a pattern with its masks after the key.
+static int spi_seq_decode_request(struct spi_seq_table *table, const struct spi_sequence *seq,
+                                  struct spi_seq_entry *entry, u8 *mask, u32 data_len, u32 data_size) {
+    u8 *val = table->data + data_len;
+    int ret;
+    u32 len;
+    u32 key_len;
+    u32 i;
+
+    ret = spi_seq_decode_pattern(seq->received, seq->received_len, val, mask, data_size - data_len);
+    if (ret <= 0)
+        return -EINVAL;
+    len = ret;
+    if (seq->length && seq->length < len)
+        return -ERANGE;
+
+    key_len = len;
+    while (key_len && !mask[key_len - 1])
+        key_len--;
+
+    entry->req_off = data_len;
+    entry->req_len = key_len;
+    entry->min_len = seq->length ? seq->length : len;
+    entry->flags   = seq->exact ? SPI_SEQ_EXACT : 0;
+    entry->hash    = spi_seq_hash(val, key_len);
+
+    for (i = 0; i < key_len && mask[i] == 0xFF; i++)
+        ;
+    if (i == key_len && key_len)
+        return 0;
+
+    if (key_len > SPI_SEQ_MAX_PATTERN_LEN || table->nr_patterns == SPI_SEQ_MAX_PATTERNS)
+        return -E2BIG;
+    memcpy(val + key_len, mask, key_len);
+    entry->flags |= SPI_SEQ_PATTERN;
+    return 0;
+}
+
+// Build the candidate bitmaps, a pattern accepts every byte value past its key
+static int spi_seq_build_patterns(struct spi_seq_table *table) {
+    u32 words = BITS_TO_LONGS(table->nr_patterns);
+    u32 bit;
+    u32 pos;
+    u32 v;
+
+    table->pattern_bits =
+            kvcalloc((size_t) table->pattern_len * 256 * words, sizeof(unsigned long), GFP_KERNEL);
+    if (!table->pattern_bits)
+        return -ENOMEM;
+
+    for (bit = 0; bit < table->nr_patterns; bit++) {
+        const struct spi_seq_entry *entry = &table->entries[table->patterns[bit]];
+        const u8                   *val   = table->data + entry->req_off;
+        const u8                   *mask  = val + entry->req_len;
+
+        for (pos = 0; pos < table->pattern_len; pos++) {
+            unsigned long *bits = table->pattern_bits + (size_t) pos * 256 * words;
+
+            for (v = 0; v < 256; v++, bits += words) {
+                if (pos >= entry->req_len || (v & mask[pos]) == val[pos])
+                    __set_bit(bit, bits);
+            }
+        }
+    }
+    return 0;
+}
+
+// Allocate a table as one block, the sections sized for the given counts
+static struct spi_seq_table *spi_seq_alloc(u32 nr_entries, u32 nr_buckets, u32 nr_key_lens, u32 nr_patterns,
+                                           u32 nr_resps, u32 nr_refs, u32 data_size) {
+    struct spi_seq_table *table;
+    size_t                size;
+
+    size = sizeof(*table) + (size_t) nr_entries * sizeof(struct spi_seq_entry) +
+           ((size_t) nr_buckets + nr_key_lens + nr_patterns) * sizeof(u32) +
+           (size_t) nr_resps * sizeof(struct spi_seq_resp) + (size_t) nr_refs * sizeof(struct spi_seq_ref) +
+           ((size_t) nr_entries + 1) * sizeof(atomic_t) + data_size;
+    table = kvzalloc(size, GFP_KERNEL);
+    if (!table)
+        return NULL;
+
+    table->nr_buckets = nr_buckets;
+    table->entries    = (struct spi_seq_entry *) (table + 1);
+    table->buckets    = (u32 *) (table->entries + nr_entries);
+    table->key_lens   = table->buckets + nr_buckets;
+    table->patterns   = table->key_lens + nr_key_lens;
+    table->resps      = (struct spi_seq_resp *) (table->patterns + nr_patterns);
+    table->refs       = (struct spi_seq_ref *) (table->resps + nr_resps);
+    table->cursors    = (atomic_t *) (table->refs + nr_refs);
+    table->state      = table->cursors + nr_entries;
+    table->data       = (u8 *) (table->state + 1);
+    return table;
+}
+
+// Compile the parsed sequences into a hash table keyed on the request bytes, and the
+// pattern bitmaps. The first sequence wins when the same request is defined more than once.
+struct spi_seq_table *spi_seq_compile(struct list_head *sequences) {
+    struct spi_seq_table *table;
+    struct spi_sequence  *seq;
+    struct spi_seq_states states    = {0};
+    u8                   *mask      = NULL;
+    u32                   count     = 0;
+    u32                   data_size = 0;
+    u32                   nr_resps  = 0;
+    u32                   nr_refs   = 0;
+    u32                   nr_names  = 1;
+    u32                   nr_buckets;
+    u32                   data_len = 0;
+    u32                   max_len  = 0;
+    u32                   src      = 0;
+    u32                   i;
+
+    // Every decoded byte takes at least one character, a pattern byte and its mask at least one,
+    // so the string lengths bound the data area. Each sequence names at most its state, its next
+    // state and one state per response, and every "$" is at most one reference.
+    list_for_each_entry(seq, sequences, list) {
+        count++;
+        data_size += 2 * seq->received_len + seq->response_len;
+        nr_resps += max_t(u32, seq->nr_responses, 1);
+        nr_names += 2 + max_t(u32, seq->nr_responses, 1);
+        max_len = max(max_len, seq->received_len);
+        for (i = 0; i < seq->response_len; i++)
+            nr_refs += seq->response[i] == '$';
+    }
+
+    nr_buckets = roundup_pow_of_two(max_t(u32, count * 2, 16));
+
+    states.names = kvmalloc_array(min_t(u32, nr_names, SPI_SEQ_MAX_STATES), sizeof(*states.names), GFP_KERNEL);
+    states.lens  = kvmalloc_array(min_t(u32, nr_names, SPI_SEQ_MAX_STATES), sizeof(*states.lens), GFP_KERNEL);
+    mask         = kvmalloc(max(max_len, 1u), GFP_KERNEL);
+    table        = spi_seq_alloc(count, nr_buckets, count, count, nr_resps, nr_refs, data_size);
+    if (!states.names || !states.lens || !mask || !table) {
+        kvfree(table);
+        table = NULL;
+        goto out;
+    }
+    spi_seq_state(&states, "", 0);
+    memset(table->buckets, 0xff, nr_buckets * sizeof(u32));
+
+    list_for_each_entry(seq, sequences, list) {
+        struct spi_seq_entry *entry = &table->entries[table->nr_entries];
+        u32                   pos   = src++;
+        u32                  *slot;
+        u32                   resp_end;
+        int                   ret;
+        int                   state;
+        int                   next;
+
+        ret = spi_seq_decode_request(table, seq, entry, mask, data_len, data_size);
+        if (ret == -ERANGE) {
+            spi_seq_warn("Skipping sequence '%.*s' longer than its length %u\n", (int) seq->received_len,
+                         seq->received, seq->length);
+            continue;
+        }
+        if (ret == -E2BIG) {
+            spi_seq_warn("Skipping pattern '%.*s', at most %u patterns of %u bytes\n", (int) seq->received_len,
+                         seq->received, SPI_SEQ_MAX_PATTERNS, SPI_SEQ_MAX_PATTERN_LEN);
+            continue;
+        }
+        if (ret) {
+            spi_seq_warn("Skipping sequence with invalid request '%.*s'\n", (int) seq->received_len, seq->received);
+            continue;
+        }
+
+        state = seq->state ? spi_seq_state(&states, seq->state, seq->state_len) : 0;
+        next  = seq->next ? spi_seq_state(&states, seq->next, seq->next_len) : 0;
+        if (state < 0 || next < 0) {
+            spi_seq_warn("Skipping sequence '%.*s', more than %u states\n", (int) seq->received_len,
+                         seq->received, SPI_SEQ_MAX_STATES);
+            continue;
+        }
+        entry->state      = seq->state ? (u32) state : SPI_SEQ_NONE;
+        entry->next_state = seq->next ? (u32) next : SPI_SEQ_NONE;
+        entry->src        = pos;
+
+        if (!(entry->flags & SPI_SEQ_PATTERN) && spi_seq_duplicate(table, entry)) {
+            spi_seq_warn("Skipping duplicate sequence '%.*s'\n", (int) seq->received_len, seq->received);
+            continue;
+        }
+
+        resp_end = data_len + ((entry->flags & SPI_SEQ_PATTERN) ? 2 : 1) * entry->req_len;
+        if (spi_seq_decode_responses(table, &states, seq, entry, &resp_end, data_size)) {
+            spi_seq_warn("Skipping sequence with invalid response '%.*s'\n", (int) seq->response_len,
+                         seq->response);
+            continue;
+        }
+        table->nr_resps += entry->nr_resps;
+        data_len = resp_end;
+        table->max_req_len = max(table->max_req_len, entry->req_len);
+
+        // Patterns are in no bucket chain
+        entry->next = SPI_SEQ_NONE;
+        if (entry->flags & SPI_SEQ_PATTERN) {
+            table->pattern_len                      = max(table->pattern_len, entry->req_len);
+            table->patterns[table->nr_patterns++] = table->nr_entries++;
+            continue;
+        }
+        spi_seq_add_key_len(table, entry->req_len);
+
+        // Append to the end of the bucket chain so lookups keep the file order
+        slot        = &table->buckets[entry->hash & (nr_buckets - 1)];
+        while (*slot != SPI_SEQ_NONE)
+            slot = &table->entries[*slot].next;
+        *slot = table->nr_entries++;
+    }
+
+    table->data_len = data_len;
+    if (table->nr_patterns && spi_seq_build_patterns(table)) {
+        kvfree(table);
+        table = NULL;
+    }
+
+out:
+    kvfree(mask);
+    kvfree(states.names);
+    kvfree(states.lens);
+    return table;
+}
+
+void spi_seq_free(struct spi_seq_table *table) {
+    if (table)
+        kvfree(table->pattern_bits);
+    kvfree(table);
+}
+
+static u8 *spi_seq_put(u8 *pos, const void *src, size_t len) {
+    memcpy(pos, src, len);
+    return pos + len;
+}
+
+static const u8 *spi_seq_take(void *dst, const u8 *pos, size_t len) {
+    memcpy(dst, pos, len);
+    return pos + len;
+}
+
+// Size of an image with the section counts of hdr
+static u64 spi_seq_image_size(const struct spi_seq_image *hdr) {
+    return sizeof(*hdr) + (u64) hdr->nr_entries * sizeof(struct spi_seq_entry) +
+           ((u64) hdr->nr_buckets + hdr->nr_key_lens + hdr->nr_patterns) * sizeof(u32) +
+           (u64) hdr->nr_resps * sizeof(struct spi_seq_resp) + (u64) hdr->nr_refs * sizeof(struct spi_seq_ref) +
+           hdr->data_len;
+}
+
+// Write a compiled table as an image, allocated here and released with kvfree
+int spi_seq_save_image(const struct spi_seq_table *table, void **image, size_t *len) {
+    struct spi_seq_image hdr = {
+            .magic       = SPI_SEQ_IMAGE_MAGIC,
+            .version     = SPI_SEQ_IMAGE_VERSION,
+            .nr_entries  = table->nr_entries,
+            .nr_buckets  = table->nr_buckets,
+            .nr_key_lens = table->nr_key_lens,
+            .nr_patterns = table->nr_patterns,
+            .nr_resps    = table->nr_resps,
+            .nr_refs     = table->nr_refs,
+            .pattern_len = table->pattern_len,
+            .data_len    = table->data_len,
+    };
+    u64 size = spi_seq_image_size(&hdr);
+    u8 *pos;
+
+    if (size > U32_MAX)
+        return -E2BIG;
+    hdr.size = size;
+
+    *image = kvmalloc(size, GFP_KERNEL);
+    if (!*image)
+        return -ENOMEM;
+
+    pos = spi_seq_put(*image, &hdr, sizeof(hdr));
+    pos = spi_seq_put(pos, table->entries, (size_t) hdr.nr_entries * sizeof(struct spi_seq_entry));
+    pos = spi_seq_put(pos, table->buckets, (size_t) hdr.nr_buckets * sizeof(u32));
+    pos = spi_seq_put(pos, table->key_lens, (size_t) hdr.nr_key_lens * sizeof(u32));
+    pos = spi_seq_put(pos, table->patterns, (size_t) hdr.nr_patterns * sizeof(u32));
+    pos = spi_seq_put(pos, table->resps, (size_t) hdr.nr_resps * sizeof(struct spi_seq_resp));
+    pos = spi_seq_put(pos, table->refs, (size_t) hdr.nr_refs * sizeof(struct spi_seq_ref));
+    spi_seq_put(pos, table->data, hdr.data_len);
+    *len = size;
+    return 0;
+}
+
+static bool spi_seq_valid_state(u32 state) {
+    return state == SPI_SEQ_NONE || state < SPI_SEQ_MAX_STATES;
+}
+
+// A bucket or chain link of a loaded table, only plain entries are chained
+static bool spi_seq_valid_link(const struct spi_seq_table *table, u32 idx) {
+    return idx == SPI_SEQ_NONE || (idx < table->nr_entries && !(table->entries[idx].flags & SPI_SEQ_PATTERN));
+}
+
+// Check every index and offset of a loaded table, lookups must stay inside it whatever the image
+// holds. Hash chains have to run forward so they end, and max_req_len is derived again and has
+// to cover every key length the lookups read.
+static int spi_seq_check(struct spi_seq_table *table) {
+    u32 i;
+
+    for (i = 0; i < table->nr_buckets; i++) {
+        if (!spi_seq_valid_link(table, table->buckets[i]))
+            return -EINVAL;
+    }
+    for (i = 1; i < table->nr_key_lens; i++) {
+        if (table->key_lens[i] <= table->key_lens[i - 1])
+            return -EINVAL;
+    }
+
+    for (i = 0; i < table->nr_entries; i++) {
+        const struct spi_seq_entry *entry   = &table->entries[i];
+        bool                        pattern = entry->flags & SPI_SEQ_PATTERN;
+
+        if ((entry->flags & ~(SPI_SEQ_EXACT | SPI_SEQ_PATTERN)) || entry->min_len < entry->req_len ||
+            (u64) entry->req_off + (pattern ? 2 : 1) * (u64) entry->req_len > table->data_len ||
+            !entry->nr_resps || entry->nr_resps > SPI_SEQ_MAX_RESPS ||
+            (u64) entry->resp + entry->nr_resps > table->nr_resps || !spi_seq_valid_state(entry->state) ||
+            !spi_seq_valid_state(entry->next_state))
+            return -EINVAL;
+
+        if (!spi_seq_valid_link(table, entry->next) || (entry->next != SPI_SEQ_NONE && entry->next <= i))
+            return -EINVAL;
+        if (pattern) {
+            if (entry->req_len > table->pattern_len || entry->next != SPI_SEQ_NONE)
+                return -EINVAL;
+        } else if (entry->hash != spi_seq_hash(table->data + entry->req_off, entry->req_len)) {
+            return -EINVAL;
+        }
+        table->max_req_len = max(table->max_req_len, entry->req_len);
+    }
+
+    for (i = 0; i < table->nr_patterns; i++) {
+        if (table->patterns[i] >= table->nr_entries ||
+            !(table->entries[table->patterns[i]].flags & SPI_SEQ_PATTERN))
+            return -EINVAL;
+    }
+
+    for (i = 0; i < table->nr_resps; i++) {
+        const struct spi_seq_resp *resp = &table->resps[i];
+
+        if ((u64) resp->off + resp->len > table->data_len || (u64) resp->ref + resp->nr_refs > table->nr_refs ||
+            !spi_seq_valid_state(resp->next_state))
+            return -EINVAL;
+    }
+
+    for (i = 0; i < table->nr_refs; i++) {
+        if (table->refs[i].req >= SPI_SEQ_MAX_REF)
+            return -EINVAL;
+        table->max_req_len = max(table->max_req_len, table->refs[i].req + 1);
+    }
+
+    // Key lengths are ascending, the last one is the longest
+    if ((table->nr_key_lens && table->key_lens[table->nr_key_lens - 1] > table->max_req_len) ||
+        table->pattern_len > table->max_req_len)
+        return -EINVAL;
+    return 0;
+}
+
+// Adopt an image written by spi_seq_save_image. It is copied into a new table, checked and the
+// pattern bitmaps are built, nothing is parsed.
+int spi_seq_load_image(const void *image, size_t len, struct spi_seq_table **out) {
+    const struct spi_seq_image *hdr = image;
+    struct spi_seq_table       *table;
+    const u8                   *pos;
+    int                         ret;
+
+    if (len < sizeof(*hdr) || hdr->magic != SPI_SEQ_IMAGE_MAGIC)
+        return -EINVAL;
+    if (hdr->version != SPI_SEQ_IMAGE_VERSION) {
+        spi_seq_err("Sequence image version %u, expected %u\n", hdr->version, SPI_SEQ_IMAGE_VERSION);
+        return -EINVAL;
+    }
+    if (hdr->size != len || spi_seq_image_size(hdr) != len || !hdr->nr_buckets ||
+        (hdr->nr_buckets & (hdr->nr_buckets - 1)) || hdr->nr_key_lens > hdr->nr_entries ||
+        hdr->nr_patterns > min_t(u32, hdr->nr_entries, SPI_SEQ_MAX_PATTERNS) ||
+        hdr->pattern_len > SPI_SEQ_MAX_PATTERN_LEN)
+        return -EINVAL;
+
+    table = spi_seq_alloc(hdr->nr_entries, hdr->nr_buckets, hdr->nr_key_lens, hdr->nr_patterns, hdr->nr_resps,
+                          hdr->nr_refs, hdr->data_len);
+    if (!table)
+        return -ENOMEM;
+
+    table->nr_entries  = hdr->nr_entries;
+    table->nr_key_lens = hdr->nr_key_lens;
+    table->nr_patterns = hdr->nr_patterns;
+    table->nr_resps    = hdr->nr_resps;
+    table->nr_refs     = hdr->nr_refs;
+    table->pattern_len = hdr->pattern_len;
+    table->data_len    = hdr->data_len;
+
+    pos = (const u8 *) (hdr + 1);
+    pos = spi_seq_take(table->entries, pos, (size_t) hdr->nr_entries * sizeof(struct spi_seq_entry));
+    pos = spi_seq_take(table->buckets, pos, (size_t) hdr->nr_buckets * sizeof(u32));
+    pos = spi_seq_take(table->key_lens, pos, (size_t) hdr->nr_key_lens * sizeof(u32));
+    pos = spi_seq_take(table->patterns, pos, (size_t) hdr->nr_patterns * sizeof(u32));
+    pos = spi_seq_take(table->resps, pos, (size_t) hdr->nr_resps * sizeof(struct spi_seq_resp));
+    pos = spi_seq_take(table->refs, pos, (size_t) hdr->nr_refs * sizeof(struct spi_seq_ref));
+    spi_seq_take(table->data, pos, hdr->data_len);
+
+    ret = spi_seq_check(table);
+    if (!ret && table->nr_patterns)
+        ret = spi_seq_build_patterns(table);
+    if (ret) {
+        spi_seq_free(table);
+        return ret;
+    }
+
+    *out = table;
+    return 0;
+}
+
+// Minimal reader for the sequence file, a JSON array of objects.
+// Values are returned as spans of the text, unknown members are skipped.
+struct spi_json {
+    const char *ptr;
+    const char *end;
+};
+
+static void spi_json_ws(struct spi_json *js) {
+    while (js->ptr < js->end && isspace(*js->ptr))
+        js->ptr++;
+}
+
+static bool spi_json_consume(struct spi_json *js, char c) {
+    spi_json_ws(js);
+    if (js->ptr < js->end && *js->ptr == c) {
+        js->ptr++;
+        return true;
+    }
+    return false;
+}
+
+static int spi_json_string(struct spi_json *js, const char **str, u32 *len) {
+    if (!spi_json_consume(js, '"'))
+        return -EINVAL;
+
+    *str = js->ptr;
+    while (js->ptr < js->end && *js->ptr != '"') {
+        if (*js->ptr == '\\')
+            js->ptr++;
+        js->ptr++;
+    }
+    if (js->ptr >= js->end)
+        return -EINVAL;
+
+    *len = js->ptr - *str;
+    js->ptr++;
+    return 0;
+}
+
+static int spi_json_u32(struct spi_json *js, u32 *val) {
+    u64 num = 0;
+
+    spi_json_ws(js);
+    if (js->ptr >= js->end || !isdigit(*js->ptr))
+        return -EINVAL;
+
+    while (js->ptr < js->end && isdigit(*js->ptr)) {
+        num = num * 10 + (*js->ptr++ - '0');
+        if (num > U32_MAX)
+            return -ERANGE;
+    }
+    *val = num;
+    return 0;
+}
+
+// Skip a value of any type, nested arrays and objects included
+static int spi_json_skip(struct spi_json *js) {
+    const char *str;
+    u32         len;
+    int         depth = 0;
+
+    spi_json_ws(js);
+    while (js->ptr < js->end) {
+        char c = *js->ptr;
+
+        if (c == '"') {
+            if (spi_json_string(js, &str, &len))
+                return -EINVAL;
+        } else if (c == ']' || c == '}') {
+            if (!depth)
+                return 0; // End of the enclosing object, the scalar is done
+            depth--;
+            js->ptr++;
+        } else {
+            if (!depth && (c == ',' || isspace(c)))
+                return 0;
+            if (c == '[' || c == '{')
+                depth++;
+            js->ptr++;
+            continue;
+        }
+        if (!depth)
+            return 0;
+    }
+    return -EINVAL;
+}
+
+// Move to the next member of an object. Returns 1 with the key set, 0 at the end of the object.
+static int spi_json_member(struct spi_json *js, bool *first, const char **key, u32 *key_len) {
+    if (spi_json_consume(js, '}'))
+        return 0;
+    if (!*first && !spi_json_consume(js, ','))
+        return -EINVAL;
+    *first = false;
+
+    if (spi_json_string(js, key, key_len) || !spi_json_consume(js, ':'))
+        return -EINVAL;
+    return 1;
+}
+
+static bool spi_json_key(const char *key, u32 key_len, const char *name) {
+    return key_len == strlen(name) && !memcmp(key, name, key_len);
+}
+
+// One response of a "responses" array, "01" or {"response": "01", "repeat": 3, "next": "idle"}
+struct spi_seq_item {
+    const char *response;
+    u32         response_len;
+    u32         repeat; // Consecutive matches given this response
+    const char *next; // State entered when it is given, NULL to stay
+    u32         next_len;
+};
+
+static int spi_seq_parse_item(struct spi_json *js, struct spi_seq_item *item) {
+    const char *key;
+    u32         key_len;
+    bool        first = true;
+    int         ret;
+
+    memset(item, 0, sizeof(*item));
+    item->repeat = 1;
+    if (!spi_json_consume(js, '{'))
+        return spi_json_string(js, &item->response, &item->response_len);
+
+    while ((ret = spi_json_member(js, &first, &key, &key_len)) > 0) {
+        if (spi_json_key(key, key_len, "response"))
+            ret = spi_json_string(js, &item->response, &item->response_len);
+        else if (spi_json_key(key, key_len, "repeat"))
+            ret = spi_json_u32(js, &item->repeat);
+        else if (spi_json_key(key, key_len, "next"))
+            ret = spi_json_string(js, &item->next, &item->next_len);
+        else
+            ret = spi_json_skip(js);
+        if (ret)
+            return ret;
+    }
+    return (ret || !item->repeat || item->repeat > SPI_SEQ_MAX_RESPS) ? -EINVAL : 0;
+}
+
+// Decode one response behind the data already in the table, repeats share the bytes and references
+static int spi_seq_decode_item(struct spi_seq_table *table, struct spi_seq_states *states,
+                               const struct spi_seq_item *item, struct spi_seq_entry *entry, u32 max_resps,
+                               u32 *data_len, u32 data_size) {
+    struct spi_seq_resp resp;
+    int                 next = 0;
+    int                 len;
+    u32                 i;
+
+    if (item->repeat > max_resps - entry->nr_resps)
+        return -EINVAL;
+
+    resp.ref     = table->nr_refs;
+    resp.nr_refs = 0;
+    len = spi_seq_decode_response(item->response, item->response_len, table->data + *data_len,
+                                  data_size - *data_len, table->refs + resp.ref, &resp.nr_refs);
+    if (len < 0)
+        return len;
+    table->nr_refs += resp.nr_refs;
+
+    // Referenced request bytes are kept by the transfer paths like key bytes
+    for (i = 0; i < resp.nr_refs; i++)
+        table->max_req_len = max(table->max_req_len, table->refs[resp.ref + i].req + 1);
+
+    if (item->next)
+        next = spi_seq_state(states, item->next, item->next_len);
+    if (next < 0)
+        return next;
+
+    resp.off        = *data_len;
+    resp.len        = len;
+    resp.next_state = item->next ? (u32) next : SPI_SEQ_NONE;
+    *data_len += len;
+    for (i = 0; i < item->repeat; i++)
+        table->resps[entry->resp + entry->nr_resps++] = resp;
+    return 0;
+}
+
+// Decode the response, or every response of the array in turn
+static int spi_seq_decode_responses(struct spi_seq_table *table, struct spi_seq_states *states,
+                                    const struct spi_sequence *seq, struct spi_seq_entry *entry, u32 *data_len,
+                                    u32 data_size) {
+    struct spi_json     js = {.ptr = seq->response, .end = seq->response + seq->response_len};
+    struct spi_seq_item item;
+    int                 ret;
+
+    entry->resp     = table->nr_resps;
+    entry->nr_resps = 0;
+
+    if (!seq->nr_responses) {
+        item = (struct spi_seq_item) {.response = seq->response, .response_len = seq->response_len, .repeat = 1};
+        return spi_seq_decode_item(table, states, &item, entry, 1, data_len, data_size);
+    }
+
+    do {
+        if (spi_seq_parse_item(&js, &item))
+            return -EINVAL;
+        ret = spi_seq_decode_item(table, states, &item, entry, seq->nr_responses, data_len, data_size);
+        if (ret)
+            return ret;
+    } while (spi_json_consume(&js, ','));
+
+    return entry->nr_resps == seq->nr_responses ? 0 : -EINVAL;
+}
+
+// "responses": ["01", {"response": "02", "repeat": 3}], the span between the brackets is decoded
+// when compiling
+static int spi_seq_parse_responses(struct spi_json *js, struct spi_sequence *seq) {
+    struct spi_seq_item item;
+
+    if (!spi_json_consume(js, '['))
+        return -EINVAL;
+
+    seq->response     = js->ptr;
+    seq->nr_responses = 0;
+    do {
+        if (spi_seq_parse_item(js, &item))
+            return -EINVAL;
+        seq->nr_responses += item.repeat;
+        if (seq->nr_responses > SPI_SEQ_MAX_RESPS)
+            return -E2BIG;
+    } while (spi_json_consume(js, ','));
+
+    seq->response_len = js->ptr - seq->response;
+    return spi_json_consume(js, ']') ? 0 : -EINVAL;
+}
+
+// Parse one sequence object, e.g. {"received": "03", "length": 4, "response": "00 00 00 00 AA"}
+static int spi_seq_parse_one(struct spi_json *js, struct spi_sequence *seq) {
+    const char *key;
+    const char *str;
+    u32         key_len;
+    u32         len;
+    bool        first = true;
+    int         ret;
+
+    if (!spi_json_consume(js, '{'))
+        return -EINVAL;
+
+    while ((ret = spi_json_member(js, &first, &key, &key_len)) > 0) {
+        if (spi_json_key(key, key_len, "received")) {
+            ret = spi_json_string(js, &seq->received, &seq->received_len);
+        } else if (spi_json_key(key, key_len, "response")) {
+            ret = spi_json_string(js, &seq->response, &seq->response_len);
+            seq->nr_responses = 0;
+        } else if (spi_json_key(key, key_len, "responses")) {
+            ret = spi_seq_parse_responses(js, seq);
+        } else if (spi_json_key(key, key_len, "state")) {
+            ret = spi_json_string(js, &seq->state, &seq->state_len);
+        } else if (spi_json_key(key, key_len, "next")) {
+            ret = spi_json_string(js, &seq->next, &seq->next_len);
+        } else if (spi_json_key(key, key_len, "length")) {
+            ret = spi_json_u32(js, &seq->length);
+        } else if (spi_json_key(key, key_len, "match")) {
+            ret = spi_json_string(js, &str, &len);
+            if (!ret && spi_json_key(str, len, "exact"))
+                seq->exact = true;
+            else if (!ret && !spi_json_key(str, len, "prefix"))
+                ret = -EINVAL;
+        } else {
+            ret = spi_json_skip(js);
+        }
+        if (ret)
+            return ret;
+    }
+    return ret;
+}
+
+// Parse the sequence array into a list, the strings point into buf. The list is filled up to
+// the error on failure, spi_seq_parse_free releases it either way.
+int spi_seq_parse(const char *buf, size_t len, struct list_head *sequences) {
+    struct spi_json      js = {.ptr = buf, .end = buf + len};
+    struct spi_sequence *seq;
+    int                  ret;
+
+    if (!spi_json_consume(&js, '['))
+        return -EINVAL;
+    if (spi_json_consume(&js, ']'))
+        return 0;
+
+    do {
+        seq = kzalloc(sizeof(*seq), GFP_KERNEL);
+        if (!seq)
+            return -ENOMEM;
+        list_add_tail(&seq->list, sequences);
+
+        ret = spi_seq_parse_one(&js, seq);
+        if (ret) {
+            spi_seq_err("Invalid sequence JSON at offset %zu\n", (size_t) (js.ptr - buf));
+            return ret;
+        }
+    } while (spi_json_consume(&js, ','));
+
+    return spi_json_consume(&js, ']') ? 0 : -EINVAL;
+}
+
+void spi_seq_parse_free(struct list_head *sequences) {
+    struct spi_sequence *seq, *tmp;
+
+    list_for_each_entry_safe(seq, tmp, sequences, list) {
+        list_del(&seq->list);
+        kfree(seq);
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef SPI_SEQ_CORE_H
+#define SPI_SEQ_CORE_H
+
+// Sequence parser, compiled table and matcher shared by the driver and the userspace library.
+// Only the kernel API subset below is used, spi_seq_user.h provides it outside the kernel.
+#ifdef __KERNEL__
+#include <linux/atomic.h>
+#include <linux/bitmap.h>
+#include <linux/ctype.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#define spi_seq_err(fmt, ...)  printk(KERN_ERR "SPI Simulator: " fmt, ##__VA_ARGS__)
+#define spi_seq_warn(fmt, ...) printk(KERN_WARNING "SPI Simulator: " fmt, ##__VA_ARGS__)
+#else
+#include "spi_seq_user.h"
+#endif
+
+#define SPI_SEQ_NONE U32_MAX
+
+// Parsed sequence, the strings point into the sequence text and are only used while compiling the table
+struct spi_sequence {
+    const char      *received;
+    u32              received_len;
+    const char      *response; // A string, or the inside of the brackets of a "responses" array
+    u32              response_len;
+    u32              nr_responses; // Responses of a "responses" array with repeats, 0 for a single "response"
+    const char      *state; // Only match in this state, NULL in any state
+    u32              state_len;
+    const char      *next; // State entered once the command is complete, NULL to stay
+    u32              next_len;
+    u32              length; // Declared request length, 0 when it is the length of received
+    bool             exact; // Match only transfers of exactly length bytes
+    struct list_head list;
+};
+
+// Entry flags
+#define SPI_SEQ_EXACT   (1 << 0)
+#define SPI_SEQ_PATTERN (1 << 1) // Request with wildcard or masked bytes, matched through the pattern bitmaps
+
+// Patterns are matched in parallel, one bitmap of candidate patterns per request byte position and value
+#define SPI_SEQ_MAX_PATTERNS    1024
+#define SPI_SEQ_MAX_PATTERN_LEN 64
+#define SPI_SEQ_MAX_REF         64 // Request bytes a response can refer to with $n
+
+// The current state and the number of state changes share one word, so an entry restarts its
+// responses on every visit to its state
+#define SPI_SEQ_STATE_MASK 0xFFFF
+#define SPI_SEQ_MAX_STATES (SPI_SEQ_STATE_MASK + 1) // State 0 is the initial state ""
+#define SPI_SEQ_MAX_RESPS  SPI_SEQ_STATE_MASK // Per sequence, repeats included
+
+// Compiled sequence, request and response bytes live in the table data area.
+// The request is a key of req_len bytes followed by wildcard bytes up to min_len.
+// Patterns keep req_len mask bytes after the key, a zero mask bit matches any request bit.
+struct spi_seq_entry {
+    u32 next; // Next entry index in the same hash bucket or SPI_SEQ_NONE
+    u32 hash;
+    u32 req_off;
+    u32 req_len;
+    u32 min_len; // Shortest matching transfer, the only matching length with SPI_SEQ_EXACT
+    u32 flags;
+    u32 resp; // First response in the response list of the table
+    u32 nr_resps; // Responses given in turn, the last one repeats
+    u32 state; // Only match in this state, SPI_SEQ_NONE in any state
+    u32 next_state; // State after the command or SPI_SEQ_NONE
+    u32 src; // Position of the sequence in the sequence file, skipped sequences included
+};
+
+// Response bytes in the table data area
+struct spi_seq_resp {
+    u32 off;
+    u32 len;
+    u32 next_state; // State entered when this response is given or SPI_SEQ_NONE
+    u32 ref; // First request byte reference in the reference list of the table
+    u32 nr_refs;
+};
+
+// Response byte at pos is request byte req
+struct spi_seq_ref {
+    u32 pos;
+    u32 req;
+};
+
+// Compiled sequence table, allocated as a single block
+struct spi_seq_table {
+    u32                   nr_entries;
+    u32                   max_req_len; // Longest key or referenced request byte, no more request bytes are read
+    u32                   nr_buckets; // Power of two
+    u32                   nr_key_lens;
+    u32                   nr_resps;
+    u32                   nr_refs;
+    u32                   nr_patterns;
+    u32                   pattern_len; // Longest pattern key
+    u32                   data_len;
+    u32                  *key_lens; // Distinct key lengths in ascending order
+    u32                  *buckets; // First entry index per bucket or SPI_SEQ_NONE
+    struct spi_seq_entry *entries;
+    struct spi_seq_resp  *resps;
+    struct spi_seq_ref   *refs;
+    u32                  *patterns; // Entry index per pattern bit
+    unsigned long        *pattern_bits; // [pattern_len][256] bitmaps of the patterns accepting the byte
+    atomic_t             *cursors; // Visit and next response per entry, a reload starts over
+    atomic_t             *state; // Visit count and current state
+    u8                   *data;
+};
+
+// Precompiled table, loaded without parsing. The header is followed by the sections of the table
+// in this order: entries, buckets, key_lens, patterns, resps, refs and data. Everything is in host
+// byte order and refers to other sections by index or data offset only, so the image is adopted
+// with one copy once every index is checked. The pattern bitmaps are rebuilt when loading.
+#define SPI_SEQ_IMAGE_MAGIC   0x51455353 // "SSEQ"
+#define SPI_SEQ_IMAGE_VERSION 2
+
+struct spi_seq_image {
+    u32 magic;
+    u32 version;
+    u32 size; // Header and sections
+    u32 nr_entries;
+    u32 nr_buckets;
+    u32 nr_key_lens;
+    u32 nr_patterns;
+    u32 nr_resps;
+    u32 nr_refs;
+    u32 pattern_len;
+    u32 data_len;
+    u32 pad;
+};
+
+// Sequence Table Function Prototypes
+int                         spi_seq_parse(const char *buf, size_t len, struct list_head *sequences);
+void                        spi_seq_parse_free(struct list_head *sequences);
+struct spi_seq_table       *spi_seq_compile(struct list_head *sequences);
+void                        spi_seq_free(struct spi_seq_table *table);
+int                         spi_seq_save_image(const struct spi_seq_table *table, void **image, size_t *len);
+int                         spi_seq_load_image(const void *image, size_t len, struct spi_seq_table **table);
+const struct spi_seq_entry *spi_seq_lookup(const struct spi_seq_table *table, const u8 *req, u32 len);
+const struct spi_seq_resp  *spi_seq_respond(const struct spi_seq_table *table, const struct spi_seq_entry *entry);
+void                        spi_seq_copy(const struct spi_seq_table *table, const struct spi_seq_resp *resp,
+                                         const u8 *req, u32 req_len, u8 *out, u32 off, u32 len);
+void                        spi_seq_finish(const struct spi_seq_table *table, const struct spi_seq_entry *entry);
+
+#endif // SPI_SEQ_CORE_H
@@ -0,0 +1,158 @@
+#ifndef SPI_SEQ_USER_H
+#define SPI_SEQ_USER_H
+
+// Userspace stand-ins for the kernel API used by spi_seq_core.c, see spi_seq_core.h
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define U32_MAX UINT32_MAX
+
+#define spi_seq_err(fmt, ...)  fprintf(stderr, "spi_seq: " fmt, ##__VA_ARGS__)
+#define spi_seq_warn(fmt, ...) fprintf(stderr, "spi_seq: " fmt, ##__VA_ARGS__)
+
+#define min(a, b)                                                                                                      \
+    ({                                                                                                                 \
+        __typeof__(a) _a = (a);                                                                                        \
+        __typeof__(b) _b = (b);                                                                                        \
+        _a < _b ? _a : _b;                                                                                             \
+    })
+#define max(a, b)                                                                                                      \
+    ({                                                                                                                 \
+        __typeof__(a) _a = (a);                                                                                        \
+        __typeof__(b) _b = (b);                                                                                        \
+        _a > _b ? _a : _b;                                                                                             \
+    })
+#define min_t(type, a, b) min((type) (a), (type) (b))
+#define max_t(type, a, b) max((type) (a), (type) (b))
+
+static inline u32 roundup_pow_of_two(u32 n) {
+    return n <= 1 ? 1 : 1u << (32 - __builtin_clz(n - 1));
+}
+
+static inline int hex_to_bin(unsigned char ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    ch = tolower(ch);
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    return -1;
+}
+
+// Allocation, the gfp flags are ignored
+#define GFP_KERNEL 0
+
+#define kzalloc(size, gfp)           calloc(1, size)
+#define kvzalloc(size, gfp)          calloc(1, size)
+#define kvmalloc(size, gfp)          malloc(size)
+#define kvmalloc_array(n, size, gfp) calloc(n, size)
+#define kvcalloc(n, size, gfp)       calloc(n, size)
+#define kfree(ptr)                   free(ptr)
+#define kvfree(ptr)                  free(ptr)
+
+// Atomics, sequentially consistent like the kernel value returning operations
+typedef struct {
+    int counter;
+} atomic_t;
+
+static inline int atomic_read(const atomic_t *v) {
+    return __atomic_load_n(&v->counter, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_set(atomic_t *v, int i) {
+    __atomic_store_n(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline int atomic_cmpxchg(atomic_t *v, int old, int new) {
+    __atomic_compare_exchange_n(&v->counter, &old, new, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return old;
+}
+
+// Doubly linked list
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) {&(name), &(name)}
+#define LIST_HEAD(name)      struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list) {
+    list->next = list;
+    list->prev = list;
+}
+
+static inline void list_add_tail(struct list_head *new, struct list_head *head) {
+    new->prev        = head->prev;
+    new->next        = head;
+    head->prev->next = new;
+    head->prev       = new;
+}
+
+static inline void list_del(struct list_head *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next       = NULL;
+    entry->prev       = NULL;
+}
+
+#define container_of(ptr, type, member) ((type *) ((char *) (ptr) - offsetof(type, member)))
+#define list_entry(ptr, type, member)   container_of(ptr, type, member)
+
+#define list_for_each_entry(pos, head, member)                                                                         \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member); &pos->member != (head);                             \
+         pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+#define list_for_each_entry_safe(pos, n, head, member)                                                                 \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member),                                                     \
+        n    = list_entry(pos->member.next, __typeof__(*pos), member);                                                 \
+         &pos->member != (head); pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+// Bitmaps
+#define BITS_PER_LONG             (CHAR_BIT * sizeof(long))
+#define BITS_TO_LONGS(nr)         (((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+
+static inline void __set_bit(unsigned long nr, unsigned long *addr) {
+    addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+static inline void bitmap_fill(unsigned long *dst, unsigned int nbits) {
+    unsigned int words = BITS_TO_LONGS(nbits);
+
+    memset(dst, 0xff, words * sizeof(long));
+    if (nbits % BITS_PER_LONG)
+        dst[words - 1] = (1UL << (nbits % BITS_PER_LONG)) - 1;
+}
+
+static inline unsigned long find_next_bit(const unsigned long *addr, unsigned long size, unsigned long offset) {
+    unsigned long word;
+
+    if (offset >= size)
+        return size;
+    word = addr[offset / BITS_PER_LONG] & (~0UL << (offset % BITS_PER_LONG));
+    offset -= offset % BITS_PER_LONG;
+    while (!word) {
+        offset += BITS_PER_LONG;
+        if (offset >= size)
+            return size;
+        word = addr[offset / BITS_PER_LONG];
+    }
+    offset += __builtin_ctzl(word);
+    return offset < size ? offset : size;
+}
+
+#define for_each_set_bit(bit, addr, size)                                                                              \
+    for ((bit) = find_next_bit((addr), (size), 0); (bit) < (size); (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+#endif // SPI_SEQ_USER_H
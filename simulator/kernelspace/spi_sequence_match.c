@@ -1,13 +1,87 @@
 #include "spi_simulator.h"
 
-int read_sequence_file(void) {
-    struct file *fp;
-    char        *buf;
-    loff_t       pos = 0;
-    int          ret = 0;
-
-    // Dosyayı aç
-    fp = filp_open("/tmp/spi_sequences.json", O_RDONLY, 0);
+// Publish a new table (or NULL) and free the old one once no reader can see it
+void spi_seq_publish(struct spi_sim_dev *dev, struct spi_seq_table *table) {
+    struct spi_seq_table *old;
+
+    mutex_lock(&dev->table_mutex);
+    old = rcu_dereference_protected(dev->table, lockdep_is_held(&dev->table_mutex));
+    rcu_assign_pointer(dev->table, table);
+    mutex_unlock(&dev->table_mutex);
+
+    synchronize_srcu(&sequence_srcu);
+    spi_seq_free(old);
+}
+
+// Parse the JSON sequence text, compile it and publish the result.
+// Runs entirely in the caller's context, transfers keep using the old table until the swap.
+static int load_sequences(struct spi_sim_dev *dev, const char *buf, size_t len) {
+    struct spi_seq_table *table = NULL;
+    struct spi_sequence  *seq;
+    int                   ret;
+    LIST_HEAD(sequences);
+
+    // JSON'ı parse et, değerler buf içini gösterir ve derlenene kadar geçerlidir
+    ret = spi_seq_parse(buf, len, &sequences);
+
+    // Tabloyu derle, ayrıştırılmış listeye artık gerek yok
+    if (!ret) {
+        list_for_each_entry(seq, &sequences, list)
+            spi_sim_dbg("Added sequence: received=%.*s, response=%.*s, length=%u, %s\n", (int) seq->received_len,
+                        seq->received, (int) seq->response_len, seq->response, seq->length,
+                        seq->exact ? "exact" : "prefix");
+        table = spi_seq_compile(&sequences);
+    }
+    spi_seq_parse_free(&sequences);
+    if (ret)
+        return ret;
+    if (!table) {
+        spi_sim_err("Failed to allocate sequence table for %s\n", dev->name);
+        return -ENOMEM;
+    }
+
+    spi_sim_info("Compiled %u sequences for %s\n", table->nr_entries, dev->name);
+    spi_seq_publish(dev, table);
+    return 0;
+}
+
+// Adopt a precompiled image, it is only checked, not parsed
+static int load_image(struct spi_sim_dev *dev, const void *buf, size_t len) {
+    struct spi_seq_table *table;
+    int                   ret;
+
+    ret = spi_seq_load_image(buf, len, &table);
+    if (ret) {
+        spi_sim_err("Invalid sequence image for %s: %d\n", dev->name, ret);
+        return ret;
+    }
+
+    spi_sim_info("Loaded %u sequences from image for %s\n", table->nr_entries, dev->name);
+    spi_seq_publish(dev, table);
+    return 0;
+}
+
+int read_sequence_file(struct spi_sim_dev *dev) {
+    const struct firmware *fw;
+    struct file           *fp;
+    char                  *buf;
+    char                   path[64];
+    loff_t                 pos = 0;
+    int                    ret = 0;
+
+    // Önce derlenmiş imaj, firmware arama yolunda (ör. /lib/firmware)
+    snprintf(path, sizeof(path), SPI_SIM_SEQUENCE_IMAGE, dev->name);
+    if (!firmware_request_nowarn(&fw, path, dev->device)) {
+        ret = load_image(dev, fw->data, fw->size);
+        release_firmware(fw);
+        return ret;
+    }
+
+    // Dosyayı aç, önce cihaza özel dosya, yoksa ortak dosya
+    snprintf(path, sizeof(path), SPI_SIM_DEVICE_SEQUENCE_FILE, dev->name);
+    fp = filp_open(path, O_RDONLY, 0);
+    if (IS_ERR(fp) && PTR_ERR(fp) == -ENOENT)
+        fp = filp_open(SPI_SIM_SEQUENCE_FILE, O_RDONLY, 0);
     if (IS_ERR(fp)) {
         printk(KERN_ERR "Failed to open sequence file\n");
         return PTR_ERR(fp);
@@ -23,7 +97,7 @@ int read_sequence_file(void) {
     }
 
     // Buffer al
-    buf = kzalloc(stat.size + 1, GFP_KERNEL);
+    buf = kvzalloc(stat.size + 1, GFP_KERNEL);
     if (!buf) {
         printk(KERN_ERR "Failed to allocate buffer\n");
         filp_close(fp, NULL);
@@ -32,76 +106,50 @@ int read_sequence_file(void) {
 
     // Dosyayı oku
     ret = kernel_read(fp, buf, stat.size, &pos);
+    filp_close(fp, NULL);
     if (ret < 0) {
         printk(KERN_ERR "Failed to read sequence file\n");
-        kfree(buf);
-        filp_close(fp, NULL);
+        kvfree(buf);
         return ret;
     }
 
-    // JSON'ı parse et
-    char *ptr = buf;
-    while (*ptr) {
-        if (strncmp(ptr, "\"received\":", 11) == 0) {
-            struct spi_sequence *seq = kzalloc(sizeof(*seq), GFP_KERNEL);
-            if (!seq) {
-                printk(KERN_ERR "Failed to allocate sequence\n");
-                break;
-            }
-
-            // Received değerini al
-            ptr += 11;
-            while (*ptr && *ptr != '"')
-                ptr++;
-            if (*ptr == '"')
-                ptr++;
-            int i = 0;
-            while (*ptr && *ptr != '"' && i < 255) {
-                seq->received[i++] = *ptr++;
-            }
-            seq->received[i] = '\0';
-
-            // Response değerini al
-            while (*ptr && strncmp(ptr, "\"response\":", 11) != 0)
-                ptr++;
-            if (*ptr) {
-                ptr += 11;
-                while (*ptr && *ptr != '"')
-                    ptr++;
-                if (*ptr == '"')
-                    ptr++;
-                i = 0;
-                while (*ptr && *ptr != '"' && i < 255) {
-                    seq->response[i++] = *ptr++;
-                }
-                seq->response[i] = '\0';
-
-                // Sequence'i listeye ekle
-                mutex_lock(&sequence_mutex);
-                list_add_tail(&seq->list, &sequence_list);
-                mutex_unlock(&sequence_mutex);
-
-                printk(KERN_INFO "SPI Simulator: Added sequence: received=%s, response=%s\n", seq->received,
-                       seq->response);
-            } else {
-                kfree(seq);
-            }
-        }
-        ptr++;
-    }
-
-    kfree(buf);
-    filp_close(fp, NULL);
-    return 0;
+    ret = load_sequences(dev, buf, ret);
+    kvfree(buf);
+    return ret;
 }
 
-void clear_sequences(void) {
-    struct spi_sequence *seq, *tmp;
+// SPI_SIM_IOC_RELOAD: replace the table from user supplied JSON text or image, or from the file when buf is NULL
+int reload_sequences(struct spi_sim_dev *dev, const char __user *buf, u32 len, u32 flags) {
+    char *kbuf;
+    int   ret;
+
+    if (flags & ~SPI_SIM_RELOAD_IMAGE)
+        return -EINVAL;
+
+    if (!buf)
+        return read_sequence_file(dev);
+
+    if (len > SPI_SIM_RELOAD_MAX)
+        return -E2BIG;
 
-    mutex_lock(&sequence_mutex);
-    list_for_each_entry_safe(seq, tmp, &sequence_list, list) {
-        list_del(&seq->list);
-        kfree(seq);
+    kbuf = kvmalloc(len + 1, GFP_KERNEL);
+    if (!kbuf)
+        return -ENOMEM;
+
+    if (copy_from_user(kbuf, buf, len)) {
+        kvfree(kbuf);
+        return -EFAULT;
     }
-    mutex_unlock(&sequence_mutex);
+    kbuf[len] = '\0';
+
+    if (flags & SPI_SIM_RELOAD_IMAGE)
+        ret = load_image(dev, kbuf, len);
+    else
+        ret = load_sequences(dev, kbuf, len);
+    kvfree(kbuf);
+    return ret;
 }
+
+void clear_sequences(struct spi_sim_dev *dev) {
+    spi_seq_publish(dev, NULL);
+}
\ No newline at end of file
@@ -1,28 +1,64 @@
+#define CREATE_TRACE_POINTS
 #include "spi_simulator.h"
 #include <linux/module.h>
 #include <linux/init.h>
 
 // Global variables
-LIST_HEAD(sequence_list);
-DEFINE_MUTEX(sequence_mutex);
+DEFINE_SRCU(sequence_srcu);
 
-int            major_number;
-struct class  *spi_class  = NULL;
-struct device *spi_device = NULL;
-int            spi_mode   = 0; // Current SPI mode
+dev_t               spi_devt;
+struct class       *spi_class       = NULL;
+struct spi_sim_dev *spi_devices     = NULL;
+int                 spi_num_devices = 0;
+
+// One entry per cs_per_bus devices
+static struct spi_sim_bus *spi_buses;
 
 // Module parameters
+int spi_log_level = SPI_SIM_LOG_ERR;
+module_param_named(log_level, spi_log_level, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(log_level, "Log level: 0 none, 1 errors, 2 info, 3 debug (limited by SPI_SIM_DEBUG at build time)");
+
 static char *device_name = "spi_test";
 module_param(device_name, charp, S_IRUGO | S_IWUSR);
-MODULE_PARM_DESC(device_name, "SPI device name");
+MODULE_PARM_DESC(device_name, "SPI device name, used when a single device is simulated");
 
 static int bus_num = 0;
 module_param(bus_num, int, S_IRUGO);
-MODULE_PARM_DESC(bus_num, "SPI bus number");
+MODULE_PARM_DESC(bus_num, "SPI bus number of the first device");
 
 static int cs_num = 0;
 module_param(cs_num, int, S_IRUGO);
-MODULE_PARM_DESC(cs_num, "SPI chip select number");
+MODULE_PARM_DESC(cs_num, "SPI chip select number of the first device");
+
+static int num_devices = 1;
+module_param(num_devices, int, S_IRUGO);
+MODULE_PARM_DESC(num_devices, "Number of simulated devices, more than one creates /dev/spidevB.C nodes");
+
+static int cs_per_bus = 4;
+module_param(cs_per_bus, int, S_IRUGO);
+MODULE_PARM_DESC(cs_per_bus, "Chip selects per simulated bus before the next bus number is used");
+
+static char *model[SPI_SIM_MAX_DEVICES];
+static int   nr_models;
+module_param_array(model, charp, &nr_models, S_IRUGO);
+MODULE_PARM_DESC(model, "Device model per device: sequence (default), regmap or nor");
+
+int spi_flash_size_kb = 16384;
+module_param_named(flash_size_kb, spi_flash_size_kb, int, S_IRUGO);
+MODULE_PARM_DESC(flash_size_kb, "Size of simulated SPI NOR flash devices in KiB, a power of two from 64 to 16384");
+
+bool spi_timing = false;
+module_param_named(timing, spi_timing, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(timing, "Complete transfers after their time on the wire, serialized per bus");
+
+int spi_cs_delay_ns = 0;
+module_param_named(cs_delay_ns, spi_cs_delay_ns, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(cs_delay_ns, "Chip select setup and hold time added to every frame in timing mode");
+
+int spi_capture_entries = 16384;
+module_param_named(capture_entries, spi_capture_entries, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(capture_entries, "Records in the capture ring of a device, allocated while its trace file is open");
 
 
 static struct file_operations fops = {
@@ -31,57 +67,171 @@ static struct file_operations fops = {
         .write          = spi_write_file, // Write to the device
         .release        = spi_release, // Release the device
         .unlocked_ioctl = spi_ioctl, // Handle IOCTL commands
+        .mmap           = spi_mmap, // Map the shared ring
+        .poll           = spi_poll, // Responses to read, and the shared ring completions
+#ifdef SPI_SIM_URING_CMD
+        .uring_cmd      = spi_uring_cmd, // Handle io_uring commands
+#endif
         .owner          = THIS_MODULE,
 };
 
 
+static int spi_sim_dev_create(struct spi_sim_dev *dev, int index) {
+    int ret;
+
+    dev->index   = index;
+    dev->bus_num = bus_num + index / cs_per_bus;
+    dev->cs_num  = cs_num + index % cs_per_bus;
+    dev->bus     = &spi_buses[index / cs_per_bus];
+    mutex_init(&dev->table_mutex);
+    RCU_INIT_POINTER(dev->table, NULL);
+
+    // A single device keeps the configurable name, a board of devices follows the spidev naming
+    if (num_devices == 1) {
+        strscpy(dev->name, device_name, sizeof(dev->name));
+    } else {
+        snprintf(dev->name, sizeof(dev->name), "spidev%d.%d", dev->bus_num, dev->cs_num);
+    }
+
+    ret = spi_stats_create(dev);
+    if (ret)
+        return ret;
+
+    // Sequence table unless a device model is given for this index
+    if (index < nr_models && strcmp(model[index], "sequence") != 0) {
+        dev->model = spi_model_find(model[index]);
+        if (!dev->model) {
+            printk(KERN_ALERT "SPI Simulator: Unknown device model '%s' for %s\n", model[index], dev->name);
+            ret = -EINVAL;
+            goto err_stats;
+        }
+        ret = dev->model->init(dev);
+        if (ret)
+            goto err_stats;
+    }
+
+    cdev_init(&dev->cdev, &fops);
+    dev->cdev.owner = THIS_MODULE;
+    ret             = cdev_add(&dev->cdev, spi_devt + index, 1);
+    if (ret) {
+        printk(KERN_ALERT "SPI Simulator: Failed to add cdev for %s\n", dev->name);
+        goto err_model;
+    }
+
+    dev->device = device_create(spi_class, NULL, spi_devt + index, dev, "%s", dev->name);
+    if (IS_ERR(dev->device)) {
+        printk(KERN_ALERT "SPI Simulator: Failed to create the device %s\n", dev->name);
+        cdev_del(&dev->cdev);
+        ret = PTR_ERR(dev->device);
+        goto err_model;
+    }
+
+    // Sequence dosyasını oku
+    if (!dev->model) {
+        ret = read_sequence_file(dev);
+        if (ret) {
+            printk(KERN_WARNING "SPI Simulator: Failed to read sequence file for %s: %d\n", dev->name, ret);
+        }
+    }
+
+    return 0;
+
+err_model:
+    if (dev->model)
+        dev->model->exit(dev);
+err_stats:
+    spi_stats_destroy(dev);
+    return ret;
+}
+
+static void spi_sim_dev_destroy(struct spi_sim_dev *dev) {
+    device_destroy(spi_class, spi_devt + dev->index);
+    cdev_del(&dev->cdev);
+
+    // Sequence tablosunu temizle
+    clear_sequences(dev);
+    if (dev->model)
+        dev->model->exit(dev);
+    spi_stats_destroy(dev);
+}
+
 static int __init spi_init(void) {
     int ret;
+    int i;
 
     printk(KERN_INFO "SPI Simulator:-----------------------------------------------------------------\n");
     printk(KERN_INFO "SPI Simulator: Initializing the SPI Test Driver\n");
 
-    // Register the major number
-    major_number = register_chrdev(0, device_name, &fops);
-    if (major_number < 0) {
+    if (num_devices < 1 || num_devices > SPI_SIM_MAX_DEVICES || cs_per_bus < 1) {
+        printk(KERN_ALERT "SPI Simulator: num_devices must be 1..%d and cs_per_bus positive\n", SPI_SIM_MAX_DEVICES);
+        return -EINVAL;
+    }
+
+    spi_devices = kcalloc(num_devices, sizeof(*spi_devices), GFP_KERNEL);
+    spi_buses   = kcalloc(DIV_ROUND_UP(num_devices, cs_per_bus), sizeof(*spi_buses), GFP_KERNEL);
+    if (!spi_devices || !spi_buses) {
+        kfree(spi_devices);
+        kfree(spi_buses);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < DIV_ROUND_UP(num_devices, cs_per_bus); i++) {
+        spi_buses[i].bus_num = bus_num + i;
+        spin_lock_init(&spi_buses[i].lock);
+    }
+
+    // Register the device numbers
+    ret = alloc_chrdev_region(&spi_devt, 0, num_devices, "spi_simulator");
+    if (ret < 0) {
         printk(KERN_ALERT "SPI Simulator: Failed to register major number\n");
-        return major_number;
+        kfree(spi_devices);
+        kfree(spi_buses);
+        return ret;
     }
 
     // Register the device class
-    spi_class = class_create(device_name);
+    spi_class = class_create("spi_simulator");
     if (IS_ERR(spi_class)) {
-        unregister_chrdev(major_number, device_name);
+        unregister_chrdev_region(spi_devt, num_devices);
+        kfree(spi_devices);
+        kfree(spi_buses);
         printk(KERN_ALERT "SPI Simulator: Failed to register device class\n");
         return PTR_ERR(spi_class);
     }
 
-    // Register the device driver
-    spi_device = device_create(spi_class, NULL, MKDEV(major_number, 0), NULL, device_name);
-    if (IS_ERR(spi_device)) {
-        class_destroy(spi_class);
-        unregister_chrdev(major_number, device_name);
-        printk(KERN_ALERT "SPI Simulator: Failed to create the device\n");
-        return PTR_ERR(spi_device);
-    }
-
-    // Sequence dosyasını oku
-    ret = read_sequence_file();
-    if (ret) {
-        printk(KERN_WARNING "SPI Simulator: Failed to read sequence file: %d\n", ret);
+    // Register the devices, each with its debugfs directory
+    spi_stats_init();
+    for (i = 0; i < num_devices; i++) {
+        ret = spi_sim_dev_create(&spi_devices[i], i);
+        if (ret)
+            goto err_devices;
+        spi_num_devices++;
     }
 
-    printk(KERN_INFO "SPI Simulator: Device initialized with major number %d and name %s\n", major_number, device_name);
+    printk(KERN_INFO "SPI Simulator: %d device(s) initialized with major number %d, first device %s\n",
+           spi_num_devices, MAJOR(spi_devt), spi_devices[0].name);
     return 0;
+
+err_devices:
+    while (spi_num_devices > 0)
+        spi_sim_dev_destroy(&spi_devices[--spi_num_devices]);
+    spi_stats_exit();
+    class_destroy(spi_class);
+    unregister_chrdev_region(spi_devt, num_devices);
+    kfree(spi_devices);
+    kfree(spi_buses);
+    return ret;
 }
 
 static void __exit spi_exit(void) {
-    // Sequence listesini temizle
-    clear_sequences();
+    while (spi_num_devices > 0)
+        spi_sim_dev_destroy(&spi_devices[--spi_num_devices]);
+    spi_stats_exit();
 
-    device_destroy(spi_class, MKDEV(major_number, 0));
     class_destroy(spi_class);
-    unregister_chrdev(major_number, device_name);
+    unregister_chrdev_region(spi_devt, num_devices);
+    kfree(spi_devices);
+    kfree(spi_buses);
     printk(KERN_INFO "SPI Simulator: Device unloaded!\n");
     printk(KERN_INFO "SPI Simulator:-----------------------------------------------------------------\n");
 }
@@ -1,9 +1,13 @@
 #ifndef SPI_SIMULATOR_DRIVER_H
 #define SPI_SIMULATOR_DRIVER_H
 
+#include <linux/atomic.h>
 #include <linux/cdev.h>
+#include <linux/ctype.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/device.h>
+#include <linux/firmware.h>
 #include <linux/fs.h>
 #include <linux/gpio.h>
 #include <linux/hrtimer.h>
@@ -11,54 +15,280 @@
 #include <linux/interrupt.h>
 #include <linux/ioctl.h>
 #include <linux/kernel.h>
+#include <linux/kfifo.h>
 #include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
+#include <linux/percpu.h>
 #include <linux/poll.h>
+#include <linux/printk.h>
 #include <linux/proc_fs.h>
 #include <linux/rtc.h>
+#include <linux/rwsem.h>
 #include <linux/sched.h>
+#include <linux/sched/signal.h>
 #include <linux/seq_file.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/spi/spi.h>
 #include <linux/spi/spidev.h>
+#include <linux/spinlock.h>
+#include <linux/srcu.h>
 #include <linux/string.h>
 #include <linux/time.h>
 #include <linux/timer.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
 #include <linux/wait.h>
 #include <linux/workqueue.h>
 
+// io_uring command submission, needs the io_uring_cmd helpers of 6.7 and later
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+#include <linux/io_uring/cmd.h>
+#define SPI_SIM_URING_CMD
+#endif
 
-extern struct list_head sequence_list;
-extern struct mutex     sequence_mutex;
+#include "spi_seq_core.h"
+#include "spi_simulator_ioctl.h"
+#include "spi_simulator_trace.h"
+
+
+// Logging levels. SPI_SIM_DEBUG is the highest level compiled in (make SPI_SIM_DEBUG=3 for a debug build),
+// the log_level module parameter selects the active level at runtime.
+#define SPI_SIM_LOG_NONE  0
+#define SPI_SIM_LOG_ERR   1
+#define SPI_SIM_LOG_INFO  2
+#define SPI_SIM_LOG_DEBUG 3
+
+#ifndef SPI_SIM_DEBUG
+#define SPI_SIM_DEBUG SPI_SIM_LOG_INFO
+#endif
+
+extern int spi_log_level;
+
+#define spi_sim_enabled(level) (SPI_SIM_DEBUG >= (level) && unlikely(READ_ONCE(spi_log_level) >= (level)))
+
+// Errors can be triggered by userspace on every transfer, so they are rate limited
+#define spi_sim_err(fmt, ...)                                                                                          \
+    do {                                                                                                               \
+        if (spi_sim_enabled(SPI_SIM_LOG_ERR))                                                                          \
+            printk_ratelimited(KERN_ERR "SPI Simulator: " fmt, ##__VA_ARGS__);                                         \
+    } while (0)
+
+#define spi_sim_info(fmt, ...)                                                                                         \
+    do {                                                                                                               \
+        if (spi_sim_enabled(SPI_SIM_LOG_INFO))                                                                         \
+            printk(KERN_INFO "SPI Simulator: " fmt, ##__VA_ARGS__);                                                    \
+    } while (0)
+
+// Hot path messages, compiled out unless SPI_SIM_DEBUG >= 3 and then routed through dynamic debug
+#define spi_sim_dbg(fmt, ...)                                                                                          \
+    do {                                                                                                               \
+        if (spi_sim_enabled(SPI_SIM_LOG_DEBUG))                                                                        \
+            pr_debug("SPI Simulator: " fmt, ##__VA_ARGS__);                                                            \
+    } while (0)
+
+// Readers of every device table use sequence_srcu
+extern struct srcu_struct sequence_srcu;
+
+#define SPI_SIM_MAX_DEVICES 64
+
+// Size of the bounce buffers used to move transfer data between userspace and the simulator
+#define SPI_SIM_CHUNK_SIZE 4096
+
+// Responses of write() queued per open file for read(), room for a few of the longest ones
+#define SPI_SIM_RESP_FIFO_SIZE (4 * SPI_SIM_CHUNK_SIZE)
+
+// Sequence files, a device specific file takes precedence over the shared one
+#define SPI_SIM_SEQUENCE_FILE        "/tmp/spi_sequences.json"
+#define SPI_SIM_DEVICE_SEQUENCE_FILE "/tmp/spi_sequences_%s.json"
+
+// Precompiled sequence image of a device, requested as firmware before the sequence files
+#define SPI_SIM_SEQUENCE_IMAGE "spi_sequences_%s.bin"
+
+// Flash image loaded into a simulated SPI NOR device, when the file exists
+#define SPI_SIM_DEVICE_IMAGE_FILE "/tmp/spi_flash_%s.bin"
+
+struct spi_sim_dev;
+struct spi_sim_capture;
+
+// Simulated SPI bus, devices with the same bus number share it
+struct spi_sim_bus {
+    int        bus_num;
+    spinlock_t lock;
+    ktime_t    busy_until; // End of the last transfer scheduled on the bus
+};
+
+// Progress of a device model through one chip select frame
+struct spi_model_frame {
+    u32 pos; // Bytes clocked since chip select
+    u32 addr;
+    u8  op;
+};
+
+// Stateful device model. A device without a model answers from its sequence table.
+// xfer clocks len bytes of a frame, tx is NULL for reads and rx is NULL for writes.
+// tx and rx may be the same buffer, each tx byte is read before the rx byte at its position.
+struct spi_model_ops {
+    const char *name;
+    int (*init)(struct spi_sim_dev *dev);
+    void (*exit)(struct spi_sim_dev *dev);
+    void (*xfer)(struct spi_sim_dev *dev, struct spi_model_frame *frame, const u8 *tx, u8 *rx, u32 len);
+    void (*frame_end)(struct spi_sim_dev *dev, struct spi_model_frame *frame); // Chip select released
+};
+
+// Log2 buckets of the ioctl latency histogram, the last one also counts everything slower
+#define SPI_SIM_LATENCY_BUCKETS 32
+
+// Per-CPU device counters, see spi_stats.c
+struct spi_sim_stats {
+    u64 transfers;
+    u64 bytes_in; // Clocked out by the host
+    u64 bytes_out; // Clocked back to the host
+    u64 seq_hits;
+    u64 seq_misses;
+    u64 ioctl_errors;
+    u64 latency[SPI_SIM_LATENCY_BUCKETS];
+};
+
+#define spi_stats_add(dev, field, n) this_cpu_add((dev)->stats->field, (n))
+#define spi_stats_inc(dev, field)    this_cpu_inc((dev)->stats->field)
+
+// One simulated SPI peripheral, shown as /dev/<name>
+struct spi_sim_dev {
+    int                            index;
+    int                            bus_num;
+    int                            cs_num;
+    struct spi_sim_bus            *bus;
+    char                           name[32];
+    struct cdev                    cdev;
+    struct device                 *device;
+    struct spi_seq_table __rcu    *table;
+    struct mutex                   table_mutex; // Serializes table replacement
+    const struct spi_model_ops    *model; // NULL for the sequence table
+    void                          *model_priv;
+    struct spi_sim_stats __percpu *stats;
+    struct dentry                 *debugfs;
+    struct spi_sim_capture __rcu  *capture; // Set while the trace file is open
+};
 
 // Global variables
-extern int            major_number;
-extern struct class  *spi_class;
-extern struct device *spi_device;
-extern int            spi_mode;
-
-struct spi_sequence {
-    char             received[256];
-    char             response[256];
-    struct list_head list;
+extern dev_t               spi_devt;
+extern struct class       *spi_class;
+extern struct spi_sim_dev *spi_devices;
+extern int                 spi_num_devices;
+extern int                 spi_flash_size_kb;
+extern bool                spi_timing;
+extern int                 spi_cs_delay_ns;
+extern int                 spi_capture_entries;
+
+// Default settings of a newly opened file
+#define SPI_SIM_DEFAULT_BITS_PER_WORD 8
+#define SPI_SIM_DEFAULT_MAX_SPEED_HZ  500000
+
+// Indexes to publish once a batch of ring submissions has left the bus
+struct spi_sim_ring_post {
+    ktime_t end;
+    u32     sq_head;
+    u32     cq_tail;
+};
+
+// Kernel side of the shared ring. The header is in shared memory, so the driver keeps
+// its own copies of the indexes it owns.
+struct spi_sim_ring {
+    void                     *mem; // vmalloc_user, mapped by the client
+    size_t                    size;
+    struct spi_sim_ring_hdr  *hdr;
+    struct spi_sim_ring_sqe  *sqes;
+    struct spi_sim_ring_cqe  *cqes;
+    u8                       *data;
+    u32                       entries;
+    u32                       slot_size;
+    u32                       sq_head;
+    u32                       cq_tail;
+    u32                       posted_cq_tail; // cq_tail as last published to the client
+    wait_queue_head_t         wait; // Woken when completions are posted
+    struct hrtimer            timer; // Publishes the posts whose batch has left the bus
+    spinlock_t                post_lock; // Guards the posts against the timer
+    struct spi_sim_ring_post *posts; // entries slots, in bus order
+    u32                       post_head;
+    u32                       post_tail;
+};
+
+// Per open file configuration, so processes sharing the device do not see each other's settings
+struct spi_sim_file {
+    struct spi_sim_dev    *dev;
+    u32                    mode; // SPI_MODE_x and SPI_LSB_FIRST bits
+    u8                     bits_per_word;
+    u32                    max_speed_hz;
+    struct spi_sim_ring   *ring;
+    struct mutex           ring_mutex; // Serializes ring setup and processing
+    struct kfifo_rec_ptr_2 resps; // One record per write() response
+    struct mutex           resp_mutex; // Serializes write() and read() of the responses
+    wait_queue_head_t      resp_wait; // Woken when a response is queued or read
+    u32                    resp_reserved; // Room held by responses whose frame is still on the bus
+    u32                    resp_next; // Place in the queue of the next write
+    u32                    resp_turn; // Place of the next response to queue
 };
 
 // SPI Core Function Prototypes
-int     spi_open(struct inode *inode, struct file *file);
-int     spi_release(struct inode *inode, struct file *file);
-ssize_t spi_read_file(struct file *file, char __user *buffer, size_t len, loff_t *offset);
-ssize_t spi_write_file(struct file *file, const char __user *buf, size_t count, loff_t *ppos);
+int      spi_open(struct inode *inode, struct file *file);
+int      spi_release(struct inode *inode, struct file *file);
+ssize_t  spi_read_file(struct file *file, char __user *buffer, size_t len, loff_t *offset);
+ssize_t  spi_write_file(struct file *file, const char __user *buf, size_t count, loff_t *ppos);
+int      spi_mmap(struct file *file, struct vm_area_struct *vma);
+__poll_t spi_poll(struct file *file, poll_table *wait);
+int      spi_ring_setup(struct spi_sim_file *sf, struct spi_sim_ring_setup __user *argp);
+int      spi_ring_enter(struct spi_sim_file *sf);
 
 // SPI IOCTL Function Prototypes
 long spi_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+void spi_transfer_buf(struct spi_sim_file *sf, const struct spi_seq_table *table, u8 *buf, u32 len);
+#ifdef SPI_SIM_URING_CMD
+int spi_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
+#endif
 
 // SPI Sequence Management Function Prototypes
-int  read_sequence_file(void);
-void clear_sequences(void);
+int                         read_sequence_file(struct spi_sim_dev *dev);
+int                         reload_sequences(struct spi_sim_dev *dev, const char __user *buf, u32 len, u32 flags);
+void                        clear_sequences(struct spi_sim_dev *dev);
+void                        spi_seq_publish(struct spi_sim_dev *dev, struct spi_seq_table *table);
+
+// Device Model Function Prototypes
+const struct spi_model_ops *spi_model_find(const char *name);
+
+// Statistics Function Prototypes
+void spi_stats_init(void);
+void spi_stats_exit(void);
+int  spi_stats_create(struct spi_sim_dev *dev);
+void spi_stats_destroy(struct spi_sim_dev *dev);
+void spi_stats_latency(struct spi_sim_dev *dev, u64 ns);
+
+// Capture Function Prototypes
+extern const struct file_operations spi_capture_fops;
+void spi_capture(struct spi_sim_dev *dev, u32 mode, u32 flags, u32 speed_hz, u32 seq_id, const u8 *tx, const u8 *rx,
+                 u32 len);
+
+static inline bool spi_capture_enabled(struct spi_sim_dev *dev) {
+    return rcu_access_pointer(dev->capture) != NULL;
+}
+
+// Bus Timing Function Prototypes
+u64     spi_timing_xfer_ns(const struct spi_ioc_transfer *xfer);
+u64     spi_timing_frame_ns(const struct spi_sim_file *sf, u32 len);
+ktime_t spi_bus_reserve(struct spi_sim_bus *bus, u64 ns);
+void    spi_bus_wait(ktime_t end);
+void    spi_bus_occupy(struct spi_sim_bus *bus, u64 ns);
+
+// Position of an entry in the sequence file, as reported by the capture
+static inline u32 spi_seq_id(const struct spi_seq_table *table, const struct spi_seq_entry *entry) {
+    return entry ? entry->src : SPI_SIM_TRACE_NO_SEQ;
+}
 
 #endif // SPI_SIMULATOR_DRIVER_H
\ No newline at end of file
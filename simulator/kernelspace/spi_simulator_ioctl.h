@@ -0,0 +1,105 @@
+#ifndef SPI_SIMULATOR_IOCTL_H
+#define SPI_SIMULATOR_IOCTL_H
+
+// Simulator specific IOCTLs, shared by the driver and userspace clients
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define SPI_SIM_IOC_MAGIC 's'
+
+// Replace the sequence table of the device while transfers continue.
+// buf/len point to the JSON sequence text, buf = 0 re-reads the sequence file.
+struct spi_sim_reload {
+    __u64 buf;
+    __u32 len;
+    __u32 flags;
+};
+
+#define SPI_SIM_RELOAD_IMAGE (1 << 0) // buf holds a precompiled image (spi_seq_image) instead of JSON text
+
+#define SPI_SIM_IOC_RELOAD _IOW(SPI_SIM_IOC_MAGIC, 1, struct spi_sim_reload)
+
+// Largest sequence text or image accepted by SPI_SIM_IOC_RELOAD
+#define SPI_SIM_RELOAD_MAX (256 << 20)
+
+// io_uring IORING_OP_URING_CMD with cmd_op SPI_SIM_URING_MESSAGE runs a SPI message like
+// SPI_IOC_MESSAGE(n_xfers). The command area of the SQE holds this struct, xfers points to
+// the spi_ioc_transfer array. The completion result is the ioctl return value.
+struct spi_sim_uring_msg {
+    __u64 xfers;
+    __u32 n_xfers;
+    __u32 pad;
+};
+
+#define SPI_SIM_URING_MESSAGE 1
+
+// Most segments in one message, the same limit SPI_IOC_MESSAGE(N) has
+#define SPI_SIM_MAX_XFERS 511
+
+// Shared ring between a client and the driver, one per open file. SPI_SIM_IOC_RING_SETUP
+// allocates it and mmap() at offset 0 maps it. Every submission is one full-duplex chip
+// select frame: the client writes TX into a data slot, the driver replaces it with RX in place.
+// SPI_SIM_IOC_RING_ENTER runs the pending submissions and posts their completions, in timing
+// mode once the batch has left the bus. poll() reports posted completions as readable.
+struct spi_sim_ring_setup {
+    __u32 entries; // In: ring size, a power of two up to SPI_SIM_RING_MAX_ENTRIES
+    __u32 slot_size; // In: bytes per data slot, a power of two up to SPI_SIM_RING_MAX_SLOT
+    __u64 mmap_size; // Out: length to map
+};
+
+// Start of the mapping, offsets are from the start of the mapping
+struct spi_sim_ring_hdr {
+    __u32 sq_head; // Written by the driver
+    __u32 sq_tail; // Written by the client
+    __u32 cq_head; // Written by the client
+    __u32 cq_tail; // Written by the driver
+    __u32 entries;
+    __u32 slot_size;
+    __u32 sqe_off;
+    __u32 cqe_off;
+    __u64 data_off; // entries data slots of slot_size bytes
+};
+
+struct spi_sim_ring_sqe {
+    __u64 user_data;
+    __u32 slot;
+    __u32 len;
+};
+
+struct spi_sim_ring_cqe {
+    __u64 user_data;
+    __s32 res; // Transfer length or -errno
+    __u32 pad;
+};
+
+#define SPI_SIM_IOC_RING_SETUP _IOWR(SPI_SIM_IOC_MAGIC, 2, struct spi_sim_ring_setup)
+#define SPI_SIM_IOC_RING_ENTER _IO(SPI_SIM_IOC_MAGIC, 3)
+
+#define SPI_SIM_RING_MAX_ENTRIES 4096
+#define SPI_SIM_RING_MAX_SLOT    (64 << 10)
+#define SPI_SIM_RING_MAX_SIZE    (64 << 20)
+
+// Capture of every transfer, streamed from /sys/kernel/debug/spi_simulator/<dev>/trace while it
+// is open. read() returns whole records and blocks until one is available, unless O_NONBLOCK.
+// Records overwritten before they were read are reported by one SPI_SIM_TRACE_LOST record.
+#define SPI_SIM_TRACE_DATA   32 // Leading tx and rx bytes kept per transfer
+#define SPI_SIM_TRACE_NO_SEQ 0xFFFFFFFF
+
+#define SPI_SIM_TRACE_TX   (1 << 0) // tx holds data
+#define SPI_SIM_TRACE_RX   (1 << 1) // rx holds data
+#define SPI_SIM_TRACE_LOST (1 << 2) // len is the number of records lost before this one
+#define SPI_SIM_TRACE_CONT (1 << 3) // Same chip select frame as the previous record
+
+struct spi_sim_trace_rec {
+    __u64 ts_ns; // CLOCK_MONOTONIC
+    __u32 len; // Transfer length, tx and rx hold its first SPI_SIM_TRACE_DATA bytes at most
+    __u32 speed_hz;
+    __u32 seq_id; // Position of the matched sequence in the sequence file, from 0, or SPI_SIM_TRACE_NO_SEQ
+    __u8  mode; // SPI_MODE_x and SPI_LSB_FIRST bits
+    __u8  flags;
+    __u16 pad;
+    __u8  tx[SPI_SIM_TRACE_DATA];
+    __u8  rx[SPI_SIM_TRACE_DATA];
+};
+
+#endif // SPI_SIMULATOR_IOCTL_H
\ No newline at end of file
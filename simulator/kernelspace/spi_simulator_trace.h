@@ -0,0 +1,54 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM spi_simulator
+
+#if !defined(SPI_SIMULATOR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define SPI_SIMULATOR_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// Number of TX/RX bytes kept per trace event
+#define SPI_SIM_TRACE_BYTES 32
+
+// One event per transfer, enable with:
+//   echo 1 > /sys/kernel/tracing/events/spi_simulator/spi_sim_transfer/enable
+TRACE_EVENT(spi_sim_transfer,
+
+    TP_PROTO(const u8 *tx, const u8 *rx, u32 len, u32 speed_hz, bool found),
+
+    TP_ARGS(tx, rx, len, speed_hz, found),
+
+    TP_STRUCT__entry(
+        __field(u32, len)
+        __field(u32, speed_hz)
+        __field(bool, found)
+        __field(u32, tx_len)
+        __field(u32, rx_len)
+        __dynamic_array(u8, tx, tx ? min_t(u32, len, SPI_SIM_TRACE_BYTES) : 0)
+        __dynamic_array(u8, rx, rx ? min_t(u32, len, SPI_SIM_TRACE_BYTES) : 0)
+    ),
+
+    TP_fast_assign(
+        __entry->len      = len;
+        __entry->speed_hz = speed_hz;
+        __entry->found    = found;
+        __entry->tx_len   = tx ? min_t(u32, len, SPI_SIM_TRACE_BYTES) : 0;
+        __entry->rx_len   = rx ? min_t(u32, len, SPI_SIM_TRACE_BYTES) : 0;
+        if (tx)
+            memcpy(__get_dynamic_array(tx), tx, __entry->tx_len);
+        if (rx)
+            memcpy(__get_dynamic_array(rx), rx, __entry->rx_len);
+    ),
+
+    TP_printk("len=%u speed_hz=%u found=%d tx=[%s] rx=[%s]", __entry->len, __entry->speed_hz, __entry->found,
+              __print_hex(__get_dynamic_array(tx), __entry->tx_len),
+              __print_hex(__get_dynamic_array(rx), __entry->rx_len))
+);
+
+#endif // SPI_SIMULATOR_TRACE_H
+
+// This part must be outside the include guard
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE spi_simulator_trace
+#include <trace/define_trace.h>
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "spi_simulator.h"
+
+// Per-device counters, summed over all CPUs when read from debugfs:
+//   /sys/kernel/debug/spi_simulator/<dev>/stats    counters, one "name value" pair per line
+//   /sys/kernel/debug/spi_simulator/<dev>/latency  time spent in spi_ioctl, "ns count" per non-empty log2 bucket
+//   /sys/kernel/debug/spi_simulator/<dev>/trace    binary transfer capture, see spi_capture.c
+static struct dentry *spi_debugfs_root;
+
+static void spi_stats_sum(struct spi_sim_dev *dev, struct spi_sim_stats *sum) {
+    int cpu;
+    int i;
+
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        const struct spi_sim_stats *s = per_cpu_ptr(dev->stats, cpu);
+
+        sum->transfers += s->transfers;
+        sum->bytes_in += s->bytes_in;
+        sum->bytes_out += s->bytes_out;
+        sum->seq_hits += s->seq_hits;
+        sum->seq_misses += s->seq_misses;
+        sum->ioctl_errors += s->ioctl_errors;
+        for (i = 0; i < SPI_SIM_LATENCY_BUCKETS; i++)
+            sum->latency[i] += s->latency[i];
+    }
+}
+
+static int spi_stats_show(struct seq_file *m, void *v) {
+    struct spi_sim_stats sum;
+
+    spi_stats_sum(m->private, &sum);
+    seq_printf(m, "transfers %llu\n", sum.transfers);
+    seq_printf(m, "bytes_in %llu\n", sum.bytes_in);
+    seq_printf(m, "bytes_out %llu\n", sum.bytes_out);
+    seq_printf(m, "seq_hits %llu\n", sum.seq_hits);
+    seq_printf(m, "seq_misses %llu\n", sum.seq_misses);
+    seq_printf(m, "ioctl_errors %llu\n", sum.ioctl_errors);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(spi_stats);
+
+static int spi_latency_show(struct seq_file *m, void *v) {
+    struct spi_sim_stats sum;
+    int                  i;
+
+    spi_stats_sum(m->private, &sum);
+    for (i = 0; i < SPI_SIM_LATENCY_BUCKETS; i++) {
+        if (sum.latency[i])
+            seq_printf(m, "%llu %llu\n", i ? 1ULL << i : 0, sum.latency[i]);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(spi_latency);
+
+// Record the time one ioctl took, bucket n counts calls of [2^n, 2^(n+1)) ns
+void spi_stats_latency(struct spi_sim_dev *dev, u64 ns) {
+    u32 bucket = ns ? min_t(u32, ilog2(ns), SPI_SIM_LATENCY_BUCKETS - 1) : 0;
+
+    this_cpu_inc(dev->stats->latency[bucket]);
+}
+
+// Debugfs is optional, the counters work without it
+int spi_stats_create(struct spi_sim_dev *dev) {
+    dev->stats = alloc_percpu(struct spi_sim_stats);
+    if (!dev->stats)
+        return -ENOMEM;
+
+    dev->debugfs = debugfs_create_dir(dev->name, spi_debugfs_root);
+    debugfs_create_file("stats", 0444, dev->debugfs, dev, &spi_stats_fops);
+    debugfs_create_file("latency", 0444, dev->debugfs, dev, &spi_latency_fops);
+    debugfs_create_file("trace", 0400, dev->debugfs, dev, &spi_capture_fops);
+    return 0;
+}
+
+void spi_stats_destroy(struct spi_sim_dev *dev) {
+    debugfs_remove_recursive(dev->debugfs);
+    free_percpu(dev->stats);
+    dev->debugfs = NULL;
+    dev->stats   = NULL;
+}
+
+void spi_stats_init(void) {
+    spi_debugfs_root = debugfs_create_dir("spi_simulator", NULL);
+}
+
+void spi_stats_exit(void) {
+    debugfs_remove_recursive(spi_debugfs_root);
+}
@@ -1,13 +1,15 @@
 """
 API routes for the SPI Simulator backend.
 """
-from flask import Blueprint, request, jsonify
-from typing import Dict, Any
+import json
+from flask import Blueprint, Response, request, jsonify
+from typing import Dict, Any, Iterator
 
 from app.driver import driver_manager
-from app.spi import send_quick_command
-from app.system import get_system_status
+from app.config import SPI_BATCH_MAX, STREAM_KEEPALIVE, STREAM_RETRY, MESSAGES
+from app.spi import send_quick_command, send_batch_commands
 from app.logger import get_logs, clear_logs
+from app.stream import event_hub
 from api.schemas import (
     SPICommand,
     SPIResponse,
@@ -26,6 +28,7 @@ def send_command() -> Dict[str, Any]:
         data = request.json
         command = data.get('command')
         device_path = data.get('device_path', '/dev/spi_test')
+        read_length = data.get('read_length', 0)
         
         if not driver_manager.is_loaded():
             return jsonify({
@@ -33,7 +36,7 @@ def send_command() -> Dict[str, Any]:
                 'message': 'Driver not loaded'
             }), 400
         
-        success, message, response = send_quick_command(command, device_path)
+        success, message, response = send_quick_command(command, device_path, read_length)
         return jsonify({
             'status': 'success' if success else 'error',
             'message': message,
@@ -46,6 +49,44 @@ def send_command() -> Dict[str, Any]:
             'message': f'Error processing command: {str(e)}'
         }), 500
 
+@api.route('/spi/batch', methods=['POST'])
+def send_batch() -> Dict[str, Any]:
+    """Send many commands to the SPI device and return every response."""
+    try:
+        data = request.json
+        commands = data.get('commands')
+        device_path = data.get('device_path', '/dev/spi_test')
+        
+        if not isinstance(commands, list) or not commands:
+            return jsonify({
+                'status': 'error',
+                'message': MESSAGES['NO_COMMAND']
+            }), 400
+        if len(commands) > SPI_BATCH_MAX:
+            return jsonify({
+                'status': 'error',
+                'message': f"{MESSAGES['BATCH_TOO_LARGE']} (max {SPI_BATCH_MAX})"
+            }), 400
+        
+        if not driver_manager.is_loaded():
+            return jsonify({
+                'status': 'error',
+                'message': 'Driver not loaded'
+            }), 400
+        
+        success, message, result = send_batch_commands(commands, device_path)
+        return jsonify({
+            'status': 'success' if success else 'error',
+            'message': message,
+            **(result or {})
+        })
+        
+    except Exception as e:
+        return jsonify({
+            'status': 'error',
+            'message': f'Error processing batch: {str(e)}'
+        }), 500
+
 @api.route('/spi/config', methods=['POST'])
 def update_config() -> Dict[str, Any]:
     """Update driver configuration."""
@@ -143,10 +184,10 @@ def update_sequences() -> Dict[str, Any]:
     """Update SPI sequences."""
     try:
         sequences = request.json
-        success = driver_manager._save_sequences(sequences)
+        success, message = driver_manager.reload_sequences(sequences)
         return jsonify({
             'status': 'success' if success else 'error',
-            'message': 'Sequences updated successfully' if success else 'Failed to update sequences'
+            'message': message
         })
     except Exception as e:
         return jsonify({
@@ -159,5 +200,28 @@ def get_status() -> Dict[str, Any]:
     """Get system status."""
     return jsonify({
         'status': 'success',
-        'data': get_system_status()
+        'data': event_hub.get_status()
+    })
+
+@api.route('/stream', methods=['GET'])
+def stream_events() -> Response:
+    """Push logs, transfer records and status changes as Server-Sent Events."""
+    def generate() -> Iterator[str]:
+        subscriber = event_hub.subscribe()
+        try:
+            yield f'retry: {STREAM_RETRY}\n\n'
+            while True:
+                events, dropped = subscriber.take(STREAM_KEEPALIVE)
+                if events or dropped:
+                    batch = json.dumps({'events': events, 'dropped': dropped}, separators=(',', ':'))
+                    yield f'data: {batch}\n\n'
+                else:
+                    # Comment line, a closed connection fails on this write
+                    yield ': keepalive\n\n'
+        finally:
+            event_hub.unsubscribe(subscriber)
+
+    return Response(generate(), mimetype='text/event-stream', headers={
+        'Cache-Control': 'no-cache',
+        'X-Accel-Buffering': 'no'
     })
@@ -1,13 +1,14 @@
 """
 API request and response schemas for the SPI Simulator backend.
 """
-from typing import List, Dict, Optional
+from typing import List, Dict, Optional, Union
 from pydantic import BaseModel, Field
 
 class SPICommand(BaseModel):
     """SPI command request model."""
     command: str = Field(..., description="Space-separated hex string command")
     device_path: Optional[str] = Field(None, description="Path to SPI device")
+    read_length: Optional[int] = Field(None, description="Bytes to clock in the frame, zeros follow the command")
 
 class SPIResponse(BaseModel):
     """SPI command response model."""
@@ -15,6 +16,18 @@ class SPIResponse(BaseModel):
     message: str = Field(..., description="Response message")
     response: Optional[str] = Field(None, description="SPI response data")
 
+class SPIBatch(BaseModel):
+    """SPI batch request model."""
+    commands: List[Union[str, Dict]] = Field(..., description="Hex string commands, or objects with command and read_length")
+    device_path: Optional[str] = Field(None, description="Path to SPI device")
+
+class SPIBatchResponse(BaseModel):
+    """SPI batch response model."""
+    status: str = Field(..., description="Response status")
+    message: str = Field(..., description="Response message")
+    transport: Optional[str] = Field(None, description="ioctl for SPI_IOC_MESSAGE frames, write for write()/read()")
+    responses: Optional[List[Optional[str]]] = Field(None, description="SPI response data of every command")
+
 class DriverConfig(BaseModel):
     """Driver configuration request model."""
     device_name: str = Field(..., description="Name of the SPI device")
@@ -8,6 +8,8 @@ from pathlib import Path
 BASE_DIR = Path(__file__).parent.parent
 DRIVER_PATH = Path('/home/ubuntu/Desktop/SPI_Simulator/build/output/spi_simulator_driver.ko')
 SEQUENCE_FILE = Path('/tmp/spi_sequences.json')
+DEBUGFS_DIR = Path('/sys/kernel/debug/spi_simulator')
+SYSFS_CLASS_DIR = Path('/sys/class/spi_simulator')
 
 # API Configuration
 API_HOST = os.getenv('API_HOST', '0.0.0.0')
@@ -20,13 +22,42 @@ DEFAULT_DEVICE_NAME = 'spidev0.0'
 DRIVER_MODULE_NAME = 'spi_simulator_driver'
 DEVICE_PERMISSIONS = '666'
 
+# Simulator IOCTLs (see kernelspace/spi_simulator_ioctl.h)
+SPI_SIM_IOC_RELOAD = 0x40107301  # _IOW('s', 1, struct spi_sim_reload)
+
+# Transfer capture (see struct spi_sim_trace_rec in kernelspace/spi_simulator_ioctl.h)
+SPI_SIM_TRACE_RECORD = '=QIIIBBH32s32s'  # ts_ns, len, speed_hz, seq_id, mode, flags, pad, tx, rx
+SPI_SIM_TRACE_NO_SEQ = 0xFFFFFFFF
+SPI_SIM_TRACE_TX = 1 << 0
+SPI_SIM_TRACE_RX = 1 << 1
+SPI_SIM_TRACE_LOST = 1 << 2
+SPI_SIM_TRACE_CONT = 1 << 3
+
 # Logging Configuration
 LOG_BUFFER_SIZE = 100
 LOG_FORMAT = '%(message)s'
 
 # SPI Configuration
 SPI_TIMEOUT = 1.0  # seconds
-SPI_READ_CHUNK_SIZE = 1  # bytes
+SPI_READ_SIZE = 4096  # bytes, the longest response (SPI_SIM_CHUNK_SIZE), one read returns a whole response
+SPI_UNKNOWN_COMMAND = b'Unknown command'  # Start of the driver's response to a command without a sequence
+SPI_MODE = 0
+SPI_BITS_PER_WORD = 8
+SPI_SPEED_HZ = 1000000
+SPI_BATCH_MAX = 10000  # commands per /spi/batch request
+
+# Shared build of test/linux_spi.c, sessions fall back to write()/read() without it
+SPI_LIBRARY = Path(os.getenv('SPI_LIBRARY', BASE_DIR.parents[2] / 'test' / 'build' / 'liblinux_spi.so'))
+
+# Streaming Configuration
+STREAM_BATCH_INTERVAL = 0.1  # seconds an event waits for others to share its message
+STREAM_BATCH_MAX = 1000  # events per message
+STREAM_QUEUE_SIZE = 100000  # events queued per client, newer ones are dropped and counted
+STREAM_STATUS_INTERVAL = 1.0  # seconds between status and counter samples
+STREAM_KEEPALIVE = 15.0  # seconds
+STREAM_RETRY = 2000  # milliseconds before the browser reconnects
+STREAM_CAPTURE_RETRY = 10.0  # seconds before a capture that could not start is tried again
+TRACE_READ_SIZE = 256 * 88  # bytes, 256 capture records
 
 # System Configuration
 SUDO_CHECK_TIMEOUT = 5  # seconds
@@ -37,10 +68,16 @@ MESSAGES = {
     'DRIVER_LOADED': 'Driver loaded successfully',
     'DRIVER_UNLOADED': 'Driver unloaded successfully',
     'DRIVER_NOT_LOADED': 'Driver not loaded',
+    'DRIVER_UNLOADING': 'Driver is being unloaded',
     'DEVICE_NOT_FOUND': 'SPI device does not exist',
     'PERMISSION_DENIED': 'Permission denied. Try running with sudo.',
     'NO_COMMAND': 'No command provided',
+    'INVALID_COMMAND': 'Command is not a hex string',
+    'BATCH_TOO_LARGE': 'Too many commands in one batch',
     'TIMEOUT': 'No response received within timeout period',
+    'UNKNOWN_COMMAND': 'No sequence matches the command',
     'SEQUENCES_UPDATED': 'Sequences updated successfully',
+    'SEQUENCES_RELOADED': 'Sequences reloaded into the running driver',
+    'RELOAD_NOT_PERMITTED': 'Sequences saved for the next driver load, reloading the running driver needs root',
     'LOGS_CLEARED': 'Logs cleared successfully'
 }
@@ -3,7 +3,11 @@ Driver management module for the SPI Simulator backend.
 """
 import os
 import json
-from typing import List, Dict, Optional, Tuple
+import fcntl
+import struct
+import ctypes
+import threading
+from typing import Callable, List, Dict, Optional, Tuple
 
 from .config import (
     DRIVER_PATH,
@@ -11,6 +15,8 @@ from .config import (
     DEFAULT_DEVICE_NAME,
     DEVICE_PERMISSIONS,
     SEQUENCE_FILE,
+    SYSFS_CLASS_DIR,
+    SPI_SIM_IOC_RELOAD,
     MESSAGES
 )
 from .logger import log_info
@@ -28,6 +34,9 @@ class DriverManager:
     def __init__(self):
         self.device_name: Optional[str] = None
         self.driver_path = str(DRIVER_PATH)
+        self.lock = threading.RLock()  # Held while the module is removed
+        self.unloading = False  # Set before the lock is taken for an unload
+        self._unload_hooks: List[Callable[[], None]] = []
         self._ensure_driver_path()
     
     def _ensure_driver_path(self) -> None:
@@ -40,10 +49,24 @@ class DriverManager:
         success, output = run_command(['lsmod'])
         return success and DRIVER_MODULE_NAME in output
     
+    def on_unload(self, hook: Callable[[], None]) -> None:
+        """Run hook before rmmod, for users that keep files of the driver open."""
+        self._unload_hooks.append(hook)
+    
     def get_device_path(self) -> Optional[str]:
         """Get the current device path."""
         return f"/dev/{self.device_name}" if self.device_name else None
     
+    def get_devices(self) -> List[str]:
+        """Get the names of every device of the loaded driver, one per num_devices."""
+        if not SYSFS_CLASS_DIR.is_dir():
+            return []
+        return sorted(entry.name for entry in SYSFS_CLASS_DIR.iterdir())
+    
+    def get_device_paths(self) -> List[str]:
+        """Get the paths of every device of the loaded driver."""
+        return [f"/dev/{device}" for device in self.get_devices()]
+    
     def load(self, device_name: str = DEFAULT_DEVICE_NAME, sequences: Optional[List[Dict]] = None) -> Tuple[bool, str]:
         """
         Load the kernel driver with the specified device name.
@@ -108,7 +131,15 @@ class DriverManager:
                 self.device_name = None
                 return True, MESSAGES['DRIVER_UNLOADED']
             
-            success, message = run_command(['sudo', 'rmmod', DRIVER_MODULE_NAME])
+            # Open device and debugfs files hold the module
+            self.unloading = True
+            try:
+                with self.lock:
+                    for hook in self._unload_hooks:
+                        hook()
+                    success, message = run_command(['sudo', 'rmmod', DRIVER_MODULE_NAME])
+            finally:
+                self.unloading = False
             if not success:
                 return False, f"Error unloading driver: {message}"
             
@@ -121,6 +152,53 @@ class DriverManager:
             log_info(f"[ERROR] {error_msg}")
             return False, error_msg
     
+    def reload_sequences(self, sequences: List[Dict]) -> Tuple[bool, str]:
+        """
+        Swap the sequence table of the running driver without rmmod/insmod.
+        
+        The sequences are also saved to the sequence file so the next
+        driver load starts with the same table.
+        
+        Args:
+            sequences: List of SPI sequences
+            
+        Returns:
+            Tuple of (success, message)
+        """
+        with self.lock:
+            if self.unloading:
+                return False, MESSAGES['DRIVER_UNLOADING']
+            
+            if not self._save_sequences(sequences):
+                return False, 'Failed to update sequences'
+            
+            if not self.is_loaded():
+                return True, MESSAGES['SEQUENCES_UPDATED']
+            
+            device_paths = self.get_device_paths()
+            data = json.dumps(sequences).encode()
+            buf = ctypes.create_string_buffer(data, len(data))
+            request = struct.pack('QII', ctypes.addressof(buf), len(data), 0)
+            
+            for device_path in device_paths:
+                try:
+                    fd = os.open(device_path, os.O_RDWR)
+                    try:
+                        fcntl.ioctl(fd, SPI_SIM_IOC_RELOAD, request)
+                    finally:
+                        os.close(fd)
+                except PermissionError:
+                    # The driver only takes new tables from CAP_SYS_ADMIN
+                    log_info(f"[ERROR] {MESSAGES['RELOAD_NOT_PERMITTED']}")
+                    return False, MESSAGES['RELOAD_NOT_PERMITTED']
+                except OSError as e:
+                    error_msg = f"Error reloading sequences into {device_path}: {str(e)}"
+                    log_info(f"[ERROR] {error_msg}")
+                    return False, error_msg
+            
+            log_info(f"[SUCCESS] Reloaded {len(sequences)} sequences into {len(device_paths)} devices")
+            return True, MESSAGES['SEQUENCES_RELOADED']
+    
     def _save_sequences(self, sequences: List[Dict]) -> bool:
         """
         Save SPI sequences to file.
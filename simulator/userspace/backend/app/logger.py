@@ -4,7 +4,7 @@ Logging configuration for the SPI Simulator backend.
 import logging
 from datetime import datetime
 from collections import deque
-from typing import Optional, List
+from typing import Callable, Optional, List
 
 from .config import LOG_BUFFER_SIZE, LOG_FORMAT
 
@@ -15,6 +15,7 @@ class LogBufferHandler(logging.Handler):
         super().__init__()
         self.buffer = deque(maxlen=buffer_size)
         self.last_message: Optional[str] = None
+        self.listeners: List[Callable[[str], None]] = []
         
     def emit(self, record: logging.LogRecord) -> None:
         """Emit a log record to the buffer."""
@@ -24,8 +25,12 @@ class LogBufferHandler(logging.Handler):
             # Avoid duplicate consecutive messages
             if msg != self.last_message:
                 timestamp = datetime.now().strftime('%H:%M:%S')
-                self.buffer.append(f"[{timestamp}] {msg}")
+                line = f"[{timestamp}] {msg}"
+                self.buffer.append(line)
                 self.last_message = msg
+                # The buffer only keeps the latest messages, listeners see every one
+                for listener in self.listeners:
+                    listener(line)
                 
         except Exception:
             self.handleError(record)
@@ -58,6 +63,10 @@ def get_logs() -> List[str]:
     """Get all logs from the buffer."""
     return handler.get_logs()
 
+def add_log_listener(listener: Callable[[str], None]) -> None:
+    """Call listener with every message added to the buffer."""
+    handler.listeners.append(listener)
+
 def clear_logs() -> None:
     """Clear all logs from the buffer."""
     handler.clear()
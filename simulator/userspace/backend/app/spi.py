@@ -1,119 +1,337 @@
 """
 SPI communication module for the SPI Simulator backend.
 """
+import ctypes
 import os
-import time
-from typing import List, Optional, Tuple
+import select
+import threading
+from typing import Dict, List, Optional, Tuple
 
-from .config import SPI_TIMEOUT, SPI_READ_CHUNK_SIZE, MESSAGES
+from .config import (
+    SPI_TIMEOUT,
+    SPI_READ_SIZE,
+    SPI_UNKNOWN_COMMAND,
+    SPI_MODE,
+    SPI_BITS_PER_WORD,
+    SPI_SPEED_HZ,
+    SPI_LIBRARY,
+    MESSAGES
+)
+from .driver import driver_manager
 from .logger import log_info
 from .utils import check_device_exists
 
+class SPIConfig(ctypes.Structure):
+    """spi_config_t of test/linux_spi.h."""
+    _fields_ = [
+        ('spidev_fd', ctypes.c_int),
+        ('mode', ctypes.c_uint8),
+        ('bits', ctypes.c_uint8),
+        ('speed', ctypes.c_uint32),
+        ('delay', ctypes.c_uint16),
+        ('lsb', ctypes.c_uint32),
+        ('device', ctypes.c_char_p),
+        ('scratch', ctypes.POINTER(ctypes.c_uint8)),
+        ('scratch_size', ctypes.c_uint32)
+    ]
+
+_library: Optional[ctypes.CDLL] = None
+_library_checked = False
+
+def _load_library() -> Optional[ctypes.CDLL]:
+    """Load liblinux_spi once, None when it has not been built."""
+    global _library, _library_checked
+    if _library_checked:
+        return _library
+    _library_checked = True
+
+    try:
+        lib = ctypes.CDLL(str(SPI_LIBRARY))
+    except OSError as e:
+        log_info(f'[SPI] {SPI_LIBRARY} not loaded ({e}), using write()/read() for commands')
+        return None
+
+    config = ctypes.POINTER(SPIConfig)
+    lib.spi_init.argtypes = [config]
+    lib.spi_deinit.argtypes = [config]
+    lib.spi_transfer_batch.argtypes = [config, ctypes.c_char_p, ctypes.c_char_p,
+                                       ctypes.POINTER(ctypes.c_uint32), ctypes.c_uint32]
+    _library = lib
+    return lib
+
+def _hex_to_bytes(hex_str: str) -> bytes:
+    """Convert space-separated hex string to bytes."""
+    try:
+        return bytes.fromhex(hex_str)
+    except ValueError:
+        # Single digit bytes like "f"
+        return bytes([int(x, 16) for x in hex_str.split()])
+
+def _bytes_to_hex(data: bytes) -> str:
+    """Convert bytes to space-separated hex string."""
+    return data.hex(' ')
+
 class SPIDevice:
-    """Handles SPI device communication."""
-    
+    """Long-lived session on one SPI device node, shared by all requests for it."""
+
     def __init__(self, device_path: str):
         self.device_path = device_path
         self._fd: Optional[int] = None
-    
-    def __enter__(self):
-        """Open the device file when entering context."""
+        self._config: Optional[SPIConfig] = None
+        self._lock = threading.Lock()
+        self._closed = False
+
+    def open(self) -> None:
+        """Open the device, through liblinux_spi when it is available."""
         if not check_device_exists(self.device_path):
             raise FileNotFoundError(f"SPI device does not exist: {self.device_path}")
-        
+
+        lib = _load_library()
         try:
-            self._fd = os.open(self.device_path, os.O_RDWR)
-            return self
+            if lib:
+                config = SPIConfig(spidev_fd=-1, mode=SPI_MODE, bits=SPI_BITS_PER_WORD, speed=SPI_SPEED_HZ,
+                                   device=self.device_path.encode())
+                if lib.spi_init(ctypes.byref(config)) < 0:
+                    if config.spidev_fd >= 0:
+                        lib.spi_deinit(ctypes.byref(config))
+                    raise OSError(f"spi_init failed for {self.device_path}")
+                self._config = config
+                self._fd = config.spidev_fd
+            else:
+                self._fd = os.open(self.device_path, os.O_RDWR)
         except PermissionError:
             raise PermissionError(MESSAGES['PERMISSION_DENIED'])
         except Exception as e:
             raise Exception(f"Error opening SPI device: {str(e)}")
-    
-    def __exit__(self, exc_type, exc_val, exc_tb):
-        """Close the device file when exiting context."""
-        if self._fd is not None:
+        log_info(f'[SPI] Session opened on {self.device_path}')
+
+    def close(self) -> None:
+        """Close the device file once the command in flight is done, later commands raise OSError."""
+        with self._lock:
+            if self._closed:
+                return
+            self._closed = True
             try:
-                os.close(self._fd)
+                if self._config is not None:
+                    _load_library().spi_deinit(ctypes.byref(self._config))
+                elif self._fd is not None:
+                    os.close(self._fd)
             except Exception as e:
                 log_info(f"Error closing file descriptor: {str(e)}")
-    
-    def _hex_to_bytes(self, hex_str: str) -> bytes:
-        """Convert space-separated hex string to bytes."""
-        return bytes([int(x, 16) for x in hex_str.split()])
-    
-    def _bytes_to_hex(self, data: bytes) -> str:
-        """Convert bytes to space-separated hex string."""
-        return ' '.join([f'{x:02x}' for x in data])
-    
-    def send_command(self, command: str) -> Tuple[bool, str, Optional[str]]:
+            self._fd = None
+            self._config = None
+
+    def _check_open(self) -> None:
+        """Refuse commands on a closed session, called with the lock held."""
+        if self._closed:
+            raise OSError(f"SPI session on {self.device_path} is closed")
+
+    def _write_read(self, command_bytes: bytes) -> bytes:
+        """One command through write(), its response through read()."""
+        bytes_written = os.write(self._fd, command_bytes)
+        if bytes_written != len(command_bytes):
+            log_info(f'[SPI] Warning: Only wrote {bytes_written} of {len(command_bytes)} bytes')
+
+        # Every write queues one response, wait until it is readable and fetch it whole
+        poller = select.poll()
+        poller.register(self._fd, select.POLLIN)
+        if not poller.poll(SPI_TIMEOUT * 1000):
+            # A late response would answer the next command, the session is dropped
+            raise TimeoutError(MESSAGES['TIMEOUT'])
+        return os.read(self._fd, SPI_READ_SIZE)
+
+    def send_command(self, command: str, read_length: int = 0) -> Tuple[bool, str, Optional[str]]:
         """
         Send a command to the SPI device and read response.
-        
+
+        The command is a batch of one frame, so it is framed and answered like every command of
+        send_batch.
+
         Args:
             command: Space-separated hex string command
-            
+            read_length: Bytes to clock in the frame, zeros follow the command
+
         Returns:
             Tuple of (success, message, response)
         """
         if not command:
             return False, MESSAGES['NO_COMMAND'], None
-        
+
         try:
-            # Convert command to bytes
-            command_bytes = self._hex_to_bytes(command)
-            log_info(f'[SPI] Sending command bytes: {command_bytes}')
-            
-            # Write command
-            bytes_written = os.write(self._fd, command_bytes)
-            if bytes_written != len(command_bytes):
-                log_info(f'[SPI] Warning: Only wrote {bytes_written} of {len(command_bytes)} bytes')
-            
-            # Read response with timeout
-            start_time = time.time()
-            response = bytearray()
-            
-            while time.time() - start_time < SPI_TIMEOUT:
-                try:
-                    chunk = os.read(self._fd, SPI_READ_CHUNK_SIZE)
-                    if not chunk:  # No more data
-                        break
-                    response.extend(chunk)
-                except BlockingIOError:
-                    time.sleep(0.01)
-                    continue
-                except Exception as e:
-                    log_info(f'[SPI] Read error: {str(e)}')
-                    break
-            
-            log_info(f'[SPI] Received response: {list(response)}')
-            
-            if not response:
-                return False, MESSAGES['TIMEOUT'], None
-            
-            return True, "Command sent successfully", self._bytes_to_hex(response)
-            
-        except Exception as e:
-            error_msg = f'SPI communication error: {str(e)}'
-            log_info(f'[SPI] {error_msg}')
-            return False, error_msg, None
+            command_bytes = _hex_to_bytes(command)
+        except ValueError:
+            return False, MESSAGES['INVALID_COMMAND'], None
+        if not command_bytes or not isinstance(read_length, int) or read_length < 0:
+            return False, MESSAGES['NO_COMMAND'], None
+
+        log_info(f'[SPI] Sending command bytes: {command_bytes}')
+        transport, responses = self.send_batch([command_bytes], [max(len(command_bytes), read_length)])
+        log_info(f'[SPI] Received response through {transport}: {responses[0]}')
+
+        if responses[0] is None:
+            return False, MESSAGES['UNKNOWN_COMMAND'], None
+
+        return True, "Command sent successfully", responses[0]
+
+    def send_batch(self, commands: List[bytes], lengths: List[int]) -> Tuple[str, List[Optional[str]]]:
+        """
+        Run every command as one full-duplex chip select frame.
+
+        With liblinux_spi all frames go through SPI_IOC_MESSAGE, SPI_BATCH_XFERS per ioctl, and
+        each response is what the device clocked out during its frame. Without it every command
+        is written and its whole response read back, misses answer None.
+
+        Args:
+            commands: Command bytes
+            lengths: Bytes to clock in each frame, zeros follow the command
 
-def send_quick_command(command: str, device_path: str) -> Tuple[bool, str, Optional[str]]:
+        Returns:
+            Tuple of (transport, responses)
+        """
+        with self._lock:
+            self._check_open()
+            if self._config is None:
+                responses = []
+                for command in commands:
+                    response = self._write_read(command)
+                    if response.startswith(SPI_UNKNOWN_COMMAND):
+                        responses.append(None)
+                    else:
+                        responses.append(_bytes_to_hex(response))
+                return 'write', responses
+
+            tx = b''.join(command.ljust(length, b'\0') for command, length in zip(commands, lengths))
+            rx = ctypes.create_string_buffer(len(tx))
+            frame_lengths = (ctypes.c_uint32 * len(lengths))(*lengths)
+            if _library.spi_transfer_batch(ctypes.byref(self._config), tx, rx, frame_lengths, len(lengths)) < 0:
+                raise OSError(f"SPI_IOC_MESSAGE failed on {self.device_path}")
+
+        data = rx.raw
+        responses = []
+        off = 0
+        for length in lengths:
+            responses.append(_bytes_to_hex(data[off:off + length]))
+            off += length
+        return 'ioctl', responses
+
+_sessions: Dict[str, SPIDevice] = {}
+_sessions_lock = threading.Lock()
+
+def get_session(device_path: str) -> SPIDevice:
+    """Return the open session of a device, opening it on first use."""
+    with _sessions_lock:
+        session = _sessions.get(device_path)
+    if session:
+        return session
+
+    # An open file holds the module, so nothing is opened once an unload has started
+    with driver_manager.lock:
+        if driver_manager.unloading:
+            raise FileNotFoundError(MESSAGES['DRIVER_UNLOADING'])
+        with _sessions_lock:
+            session = _sessions.get(device_path)
+            if session is None:
+                session = SPIDevice(device_path)
+                session.open()
+                _sessions[device_path] = session
+            return session
+
+def drop_session(session: SPIDevice) -> None:
+    """Close a broken session, the next request for its device opens a new one."""
+    with _sessions_lock:
+        # A request that saw the same failure may have replaced it already
+        if _sessions.get(session.device_path) is session:
+            del _sessions[session.device_path]
+    session.close()
+
+def close_sessions() -> None:
+    """Close all sessions, an open device node keeps the driver from unloading."""
+    with _sessions_lock:
+        sessions = list(_sessions.values())
+        _sessions.clear()
+    for session in sessions:
+        session.close()
+
+driver_manager.on_unload(close_sessions)
+
+def send_quick_command(command: str, device_path: str, read_length: int = 0) -> Tuple[bool, str, Optional[str]]:
     """
-    Quick command function that handles device opening/closing.
-    
+    Send one command through the session of the device.
+
     Args:
         command: Space-separated hex string command
         device_path: Path to the SPI device
-        
+        read_length: Bytes to clock in the frame, zeros follow the command
+
     Returns:
         Tuple of (success, message, response)
     """
+    session = None
     try:
-        with SPIDevice(device_path) as spi:
-            return spi.send_command(command)
+        session = get_session(device_path)
+        return session.send_command(command, read_length)
     except FileNotFoundError as e:
         return False, str(e), None
     except PermissionError as e:
         return False, str(e), None
+    except TimeoutError as e:
+        drop_session(session)
+        return False, str(e), None
+    except OSError as e:
+        # The node went away, broke or the session was closed, reopen on the next request
+        if session:
+            drop_session(session)
+        error_msg = f'SPI communication error: {str(e)}'
+        log_info(f'[SPI] {error_msg}')
+        return False, error_msg, None
     except Exception as e:
         return False, f"Error: {str(e)}", None
+
+def send_batch_commands(commands: List, device_path: str) -> Tuple[bool, str, Optional[Dict]]:
+    """
+    Send many commands through the session of the device.
+
+    Args:
+        commands: Hex string commands, or {"command": ..., "read_length": ...} to clock more
+                  bytes than the command has
+        device_path: Path to the SPI device
+
+    Returns:
+        Tuple of (success, message, result with transport and responses)
+    """
+    frames = []
+    lengths = []
+    for i, item in enumerate(commands):
+        command = item.get('command') if isinstance(item, dict) else item
+        read_length = item.get('read_length', 0) if isinstance(item, dict) else 0
+        try:
+            command_bytes = _hex_to_bytes(command) if isinstance(command, str) else b''
+        except ValueError:
+            return False, f"{MESSAGES['INVALID_COMMAND']}: #{i}", None
+        if not command_bytes or not isinstance(read_length, int) or read_length < 0:
+            return False, f"{MESSAGES['NO_COMMAND']}: #{i}", None
+        frames.append(command_bytes)
+        lengths.append(max(len(command_bytes), read_length))
+
+    session = None
+    try:
+        session = get_session(device_path)
+        transport, responses = session.send_batch(frames, lengths)
+    except FileNotFoundError as e:
+        return False, str(e), None
+    except PermissionError as e:
+        return False, str(e), None
+    except TimeoutError as e:
+        drop_session(session)
+        return False, str(e), None
+    except OSError as e:
+        if session:
+            drop_session(session)
+        error_msg = f'SPI communication error: {str(e)}'
+        log_info(f'[SPI] {error_msg}')
+        return False, error_msg, None
+    except Exception as e:
+        return False, f"Error: {str(e)}", None
+
+    log_info(f'[SPI] Batch of {len(frames)} commands sent through {transport}')
+    return True, "Commands sent successfully", {'transport': transport, 'responses': responses}
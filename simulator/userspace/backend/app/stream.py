@@ -0,0 +1,273 @@
+"""
+Event streaming module for the SPI Simulator backend.
+
+Log messages, transfer records of the driver's capture and changes of the status and counters
+are pushed to every subscriber. Events are batched per subscriber and queued up to
+STREAM_QUEUE_SIZE, a client that falls further behind loses the newest events and is told how
+many.
+"""
+import os
+import struct
+import subprocess
+import threading
+import time
+from collections import deque
+from typing import Dict, List, Optional, Tuple
+
+from .config import (
+    DEBUGFS_DIR,
+    SPI_SIM_TRACE_RECORD,
+    SPI_SIM_TRACE_NO_SEQ,
+    SPI_SIM_TRACE_TX,
+    SPI_SIM_TRACE_RX,
+    SPI_SIM_TRACE_LOST,
+    SPI_SIM_TRACE_CONT,
+    STREAM_BATCH_INTERVAL,
+    STREAM_CAPTURE_RETRY,
+    STREAM_BATCH_MAX,
+    STREAM_QUEUE_SIZE,
+    STREAM_STATUS_INTERVAL,
+    TRACE_READ_SIZE
+)
+from .driver import driver_manager
+from .logger import add_log_listener, get_logs, log_info
+from .system import get_system_status
+
+TRACE_RECORD = struct.Struct(SPI_SIM_TRACE_RECORD)
+
+class Subscriber:
+    """Event queue of one client."""
+
+    def __init__(self):
+        self._events = deque()
+        self._dropped = 0
+        self._cond = threading.Condition()
+
+    def put(self, events: List[Dict]) -> None:
+        """Queue events, the ones that do not fit are only counted."""
+        with self._cond:
+            was_empty = not self._events
+            room = STREAM_QUEUE_SIZE - len(self._events)
+            self._events.extend(events[:room])
+            self._dropped += max(len(events) - room, 0)
+            # Wake the sender for the first event of a batch and for a full batch
+            if (was_empty and self._events) or len(self._events) >= STREAM_BATCH_MAX:
+                self._cond.notify()
+
+    def take(self, timeout: float) -> Tuple[List[Dict], int]:
+        """
+        Wait for the next batch of events.
+
+        Args:
+            timeout: Seconds to wait for the first event
+
+        Returns:
+            Tuple of (events, events dropped since the last batch)
+        """
+        with self._cond:
+            if not self._events:
+                self._cond.wait(timeout)
+            # The first event waits a little for others to share its message
+            if self._events and len(self._events) < STREAM_BATCH_MAX:
+                self._cond.wait(STREAM_BATCH_INTERVAL)
+            count = min(len(self._events), STREAM_BATCH_MAX)
+            events = [self._events.popleft() for _ in range(count)]
+            dropped, self._dropped = self._dropped, 0
+            return events, dropped
+
+class TraceReader(threading.Thread):
+    """Streams the capture ring of one device, the ring only exists while its file is open."""
+
+    def __init__(self, device: str, hub: 'EventHub'):
+        super().__init__(daemon=True)
+        self.device = device
+        self.received = False
+        self.error = ''
+        self._hub = hub
+        # debugfs is only readable by root
+        self._proc = subprocess.Popen(['sudo', 'cat', str(DEBUGFS_DIR / device / 'trace')],
+                                      stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+
+    def _event(self, record: Tuple) -> Dict:
+        ts_ns, length, speed_hz, seq_id, mode, flags, _, tx, rx = record
+        if flags & SPI_SIM_TRACE_LOST:
+            return {'type': 'lost', 'device': self.device, 'ts_ns': ts_ns, 'count': length}
+        data_len = min(length, len(tx))
+        return {
+            'type': 'transfer',
+            'device': self.device,
+            'ts_ns': ts_ns,
+            'len': length,
+            'speed_hz': speed_hz,
+            'mode': mode,
+            'seq': None if seq_id == SPI_SIM_TRACE_NO_SEQ else seq_id,
+            'cont': bool(flags & SPI_SIM_TRACE_CONT),
+            'tx': tx[:data_len].hex(' ') if flags & SPI_SIM_TRACE_TX else None,
+            'rx': rx[:data_len].hex(' ') if flags & SPI_SIM_TRACE_RX else None
+        }
+
+    def run(self) -> None:
+        pending = b''
+        fd = self._proc.stdout.fileno()
+        # The pipe may split records, only whole ones are decoded
+        while True:
+            data = os.read(fd, TRACE_READ_SIZE)
+            if not data:
+                break
+            self.received = True
+            pending += data
+            whole = len(pending) - len(pending) % TRACE_RECORD.size
+            if whole:
+                self._hub.publish([self._event(record) for record in TRACE_RECORD.iter_unpack(pending[:whole])])
+                pending = pending[whole:]
+        self._proc.wait()
+        # The trace file takes one reader at a time, cat ends at once while another one has it
+        self.error = self._proc.stderr.read().decode(errors='replace').strip()
+        self._proc.stderr.close()
+        self._proc.stdout.close()
+
+    def stop(self) -> None:
+        """End the capture and wait until the file is closed."""
+        if self._proc.poll() is None:
+            self._proc.terminate()
+        self.join()
+
+class EventHub:
+    """Fans events out to subscribers, samples the driver while anyone listens."""
+
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._subscribers: List[Subscriber] = []
+        self._sampler: Optional[threading.Thread] = None
+        self._readers: Dict[str, TraceReader] = {}
+        self._capture_retry: Dict[str, float] = {}  # Next attempt for devices whose capture failed
+        self._status: Optional[Dict] = None
+        self._stats: Dict[str, Dict] = {}
+        self._snapshot: Optional[Dict] = None  # Last system status with stats
+        self._snapshot_time = 0.0
+
+    def subscribe(self) -> Subscriber:
+        """Add a subscriber, it starts with the buffered logs and the last known state."""
+        subscriber = Subscriber()
+        subscriber.put([{'type': 'log', 'message': line} for line in get_logs()])
+        with self._lock:
+            if self._status is not None:
+                subscriber.put([{'type': 'status', 'status': self._status}])
+            subscriber.put([{'type': 'stats', 'device': device, 'counters': counters, 'delta': {}}
+                            for device, counters in self._stats.items()])
+            self._subscribers.append(subscriber)
+            if self._sampler is None:
+                self._sampler = threading.Thread(target=self._sample, daemon=True)
+                self._sampler.start()
+        return subscriber
+
+    def unsubscribe(self, subscriber: Subscriber) -> None:
+        """Remove a subscriber, the sampler stops with the last one."""
+        with self._lock:
+            self._subscribers.remove(subscriber)
+
+    def publish(self, events: List[Dict]) -> None:
+        """Queue events for every subscriber."""
+        if not events:
+            return
+        with self._lock:
+            subscribers = list(self._subscribers)
+        for subscriber in subscribers:
+            subscriber.put(events)
+
+    def get_status(self) -> Dict:
+        """System status with driver stats, sampled at most once per STREAM_STATUS_INTERVAL."""
+        with self._lock:
+            if self._snapshot is not None and time.monotonic() - self._snapshot_time < STREAM_STATUS_INTERVAL:
+                return self._snapshot
+        return self._take_snapshot()
+
+    def _take_snapshot(self) -> Dict:
+        snapshot = get_system_status()
+        with self._lock:
+            self._snapshot, self._snapshot_time = snapshot, time.monotonic()
+        return snapshot
+
+    def stop_capture(self) -> None:
+        """Close the capture files of all devices."""
+        with self._lock:
+            readers = list(self._readers.values())
+            self._readers.clear()
+        for reader in readers:
+            reader.stop()
+
+    def _update_readers(self, devices: List[str]) -> None:
+        """Capture every device that exists, the driver is not unloaded meanwhile."""
+        now = time.monotonic()
+        with driver_manager.lock:
+            # A capture ends by itself when its device goes away
+            with self._lock:
+                stale = [reader for device, reader in self._readers.items()
+                         if device not in devices or not reader.is_alive()]
+                for reader in stale:
+                    del self._readers[reader.device]
+                # A capture still running a tick after its start has its file
+                for device in self._readers:
+                    self._capture_retry.pop(device, None)
+            for reader in stale:
+                reader.stop()
+                # Ending without a record means the file could not be read, logged once and retried later
+                if reader.device in devices and not reader.received:
+                    if reader.device not in self._capture_retry:
+                        log_info(f"[STREAM] Cannot capture {reader.device}: {reader.error or 'trace file closed'}, "
+                                 f"retrying every {STREAM_CAPTURE_RETRY:g} s")
+                    self._capture_retry[reader.device] = now + STREAM_CAPTURE_RETRY
+            self._capture_retry = {device: retry for device, retry in self._capture_retry.items() if device in devices}
+            for device in devices:
+                if device in self._readers or self._capture_retry.get(device, 0) > now:
+                    continue
+                try:
+                    reader = TraceReader(device, self)
+                except Exception as e:
+                    log_info(f"[STREAM] Cannot capture {device}: {str(e)}")
+                    continue
+                reader.start()
+                with self._lock:
+                    self._readers[device] = reader
+
+    def _sample(self) -> None:
+        """Publish status changes and counter deltas until the last subscriber leaves."""
+        while True:
+            with self._lock:
+                idle = not self._subscribers
+            if idle:
+                # The sampler is only dropped once its captures are closed, a subscriber
+                # that comes meanwhile keeps it running instead of starting a second one
+                self.stop_capture()
+                with self._lock:
+                    if not self._subscribers:
+                        self._sampler = None
+                        break
+                continue
+
+            status = self._take_snapshot()
+            stats = status['driver']['stats']
+            status = {**status, 'driver': {key: value for key, value in status['driver'].items() if key != 'stats'}}
+            events = []
+            if status != self._status:
+                events.append({'type': 'status', 'status': status})
+
+            for device, device_stats in stats.items():
+                counters = device_stats['counters']
+                previous = self._stats.get(device, {})
+                delta = {name: value - previous.get(name, 0) for name, value in counters.items()
+                         if value != previous.get(name, 0)}
+                if delta:
+                    events.append({'type': 'stats', 'device': device, 'counters': counters, 'delta': delta})
+
+            with self._lock:
+                self._status = status
+                self._stats = {device: device_stats['counters'] for device, device_stats in stats.items()}
+            self.publish(events)
+            self._update_readers(list(stats))
+            time.sleep(STREAM_STATUS_INTERVAL)
+
+# Create global event hub instance
+event_hub = EventHub()
+add_log_listener(lambda line: event_hub.publish([{'type': 'log', 'message': line}]))
+driver_manager.on_unload(event_hub.stop_capture)
@@ -1,19 +1,48 @@
 """
 System status and monitoring module for the SPI Simulator backend.
 """
-from typing import Dict
+from typing import Dict, List
 
-from .config import API_PORT, FRONTEND_PORT
-from .utils import check_port_status
+from .config import API_PORT, FRONTEND_PORT, DEBUGFS_DIR
+from .utils import check_port_status, run_command
 from .driver import driver_manager
 
+def _read_debugfs(path: str) -> List[List[str]]:
+    """Read a debugfs file of the driver as whitespace separated fields per line."""
+    # debugfs is only readable by root
+    success, output = run_command(['sudo', 'cat', path], timeout=1)
+    return [line.split() for line in output.splitlines() if line.strip()] if success else []
+
+def get_driver_stats() -> Dict:
+    """
+    Get the counters and ioctl latency histogram of every simulated device.
+    
+    Returns:
+        Dictionary keyed by device name, empty if debugfs is not available
+    """
+    stats = {}
+    # sysfs lists the devices without sudo, only their debugfs files need it
+    for device in driver_manager.get_devices():
+        counters = _read_debugfs(str(DEBUGFS_DIR / device / 'stats'))
+        latency = _read_debugfs(str(DEBUGFS_DIR / device / 'latency'))
+        stats[device] = {
+            'counters': {name: int(value) for name, value in counters},
+            # Each bucket counts calls of [from_ns, 2 * from_ns)
+            'latency': [{'from_ns': int(low), 'count': int(count)} for low, count in latency]
+        }
+    return stats
+
 def get_system_status() -> Dict:
     """
     Get the status of all system components.
     
+    Every call reads the debugfs files of the driver through sudo, the API
+    serves the snapshot of the event hub instead.
+    
     Returns:
         Dictionary containing status of backend, frontend, and driver
     """
+    driver_loaded = driver_manager.is_loaded()
     return {
         'backend': {
             'status': check_port_status(API_PORT),
@@ -24,7 +53,8 @@ def get_system_status() -> Dict:
             'port': FRONTEND_PORT
         },
         'driver': {
-            'status': driver_manager.is_loaded(),
-            'device': driver_manager.get_device_path()
+            'status': driver_loaded,
+            'device': driver_manager.get_device_path(),
+            'stats': get_driver_stats() if driver_loaded else {}
         }
     }
@@ -0,0 +1,109 @@
+// Records the SPI messages of any program talking to real spidev devices, in the capture format of
+// the simulator (struct spi_sim_trace_rec), so spi_trace_compact can turn a session on real hardware
+// into a sequence file.
+//
+// gcc -O2 -shared -fPIC -I../../kernelspace -o spi_recorder.so spi_recorder.c -ldl
+// SPI_RECORD_FILE=boot.bin LD_PRELOAD=./spi_recorder.so ./firmware_loader /dev/spidev0.0
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/spi/spidev.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include "spi_simulator_ioctl.h"
+
+typedef int (*ioctl_fn)(int, unsigned long, ...);
+
+static ioctl_fn        real_ioctl;
+static int             record_fd = -1;
+static pthread_once_t  record_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t record_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void record_open(void) {
+    const char *path = getenv("SPI_RECORD_FILE");
+
+    real_ioctl = (ioctl_fn) dlsym(RTLD_NEXT, "ioctl");
+    if (!path)
+        path = "spi_record.bin";
+    record_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (record_fd < 0)
+        fprintf(stderr, "spi_recorder: Cannot create %s: %s\n", path, strerror(errno));
+}
+
+// SPI_IOC_MESSAGE(n) for any n
+static int is_spi_message(unsigned long request) {
+    return _IOC_TYPE(request) == SPI_IOC_MAGIC && _IOC_NR(request) == 0 && _IOC_DIR(request) == _IOC_WRITE &&
+           _IOC_SIZE(request) % sizeof(struct spi_ioc_transfer) == 0;
+}
+
+// One record per segment, segments after the first of a chip select frame carry SPI_SIM_TRACE_CONT
+static void record_message(int fd, const struct spi_ioc_transfer *xfers, unsigned count) {
+    struct spi_sim_trace_rec recs[SPI_SIM_MAX_XFERS];
+    struct timespec          ts;
+    uint8_t                  mode  = 0;
+    uint32_t                 speed = 0;
+    int                      cont  = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    real_ioctl(fd, SPI_IOC_RD_MODE, &mode);
+    real_ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
+
+    memset(recs, 0, count * sizeof(recs[0]));
+    for (unsigned i = 0; i < count; i++) {
+        const struct spi_ioc_transfer *xfer = &xfers[i];
+        struct spi_sim_trace_rec      *rec  = &recs[i];
+        uint32_t                       n    = xfer->len < SPI_SIM_TRACE_DATA ? xfer->len : SPI_SIM_TRACE_DATA;
+
+        rec->ts_ns    = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        rec->len      = xfer->len;
+        rec->speed_hz = xfer->speed_hz ? xfer->speed_hz : speed;
+        rec->seq_id   = SPI_SIM_TRACE_NO_SEQ;
+        rec->mode     = mode;
+        rec->flags    = cont ? SPI_SIM_TRACE_CONT : 0;
+        if (xfer->tx_buf) {
+            rec->flags |= SPI_SIM_TRACE_TX;
+            memcpy(rec->tx, (const void *) (uintptr_t) xfer->tx_buf, n);
+        }
+        if (xfer->rx_buf) {
+            rec->flags |= SPI_SIM_TRACE_RX;
+            memcpy(rec->rx, (const void *) (uintptr_t) xfer->rx_buf, n);
+        }
+        // cs_change on a segment other than the last ends the frame after it
+        cont = !xfer->cs_change;
+    }
+
+    // Messages of different threads never interleave in the file
+    pthread_mutex_lock(&record_mutex);
+    if (write(record_fd, recs, count * sizeof(recs[0])) < 0)
+        fprintf(stderr, "spi_recorder: Write failed: %s\n", strerror(errno));
+    pthread_mutex_unlock(&record_mutex);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+    va_list ap;
+    void   *arg;
+    int     ret;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    pthread_once(&record_once, record_open);
+    ret = real_ioctl(fd, request, arg);
+
+    if (ret >= 0 && record_fd >= 0 && is_spi_message(request)) {
+        unsigned count = _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer);
+
+        if (count && count <= SPI_SIM_MAX_XFERS)
+            record_message(fd, arg, count);
+    }
+    return ret;
+}
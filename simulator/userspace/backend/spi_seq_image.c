@@ -0,0 +1,120 @@
+// Compiles a sequence file into a precompiled image the driver adopts without parsing, either as
+// firmware (/lib/firmware/spi_sequences_<dev>.bin) or through SPI_SIM_IOC_RELOAD.
+//
+// gcc -O2 -I../../kernelspace -o spi_seq_image spi_seq_image.c ../../kernelspace/spi_seq_core.c
+// ./spi_seq_image /tmp/spi_sequences.json /lib/firmware/spi_sequences_spidev0.0.bin
+// ./spi_seq_image /tmp/spi_sequences.json seq.bin /dev/spidev0.0
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include "spi_seq_core.h"
+#include "spi_simulator_ioctl.h"
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <sequence file> <image file> [device]\n", program_name);
+    printf("Example: %s /tmp/spi_sequences.json /lib/firmware/spi_sequences_spidev0.0.bin\n", program_name);
+    printf("  Writes the compiled sequence table as an image. With a device the image also\n");
+    printf("  replaces the sequence table of the running driver.\n");
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *in = fopen(path, "rb");
+    char *buf;
+    long  size;
+
+    if (!in)
+        return NULL;
+    fseek(in, 0, SEEK_END);
+    size = ftell(in);
+    rewind(in);
+
+    buf = malloc(size + 1);
+    if (buf && fread(buf, 1, size, in) != (size_t) size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(in);
+    if (buf) {
+        buf[size] = '\0';
+        *len      = size;
+    }
+    return buf;
+}
+
+static int reload_device(const char *device, const void *image, size_t len) {
+    struct spi_sim_reload reload = {.buf = (uintptr_t) image, .len = len, .flags = SPI_SIM_RELOAD_IMAGE};
+    int                   fd     = open(device, O_RDWR);
+
+    if (fd < 0) {
+        printf("Error: Cannot open device %s: %s\n", device, strerror(errno));
+        return -1;
+    }
+    if (ioctl(fd, SPI_SIM_IOC_RELOAD, &reload) < 0) {
+        printf("Error: Reload of %s failed: %s\n", device, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct spi_seq_table *table = NULL;
+    void                 *image;
+    size_t                json_len;
+    size_t                image_len;
+    double                start;
+    LIST_HEAD(sequences);
+
+    if (argc < 3 || argc > 4) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    char *json = read_file(argv[1], &json_len);
+    if (!json) {
+        printf("Error: Cannot read %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    start = now_ms();
+    if (!spi_seq_parse(json, json_len, &sequences))
+        table = spi_seq_compile(&sequences);
+    spi_seq_parse_free(&sequences);
+    if (!table) {
+        printf("Error: %s is not a valid sequence file\n", argv[1]);
+        return 1;
+    }
+    printf("%u sequences compiled in %.1f ms\n", table->nr_entries, now_ms() - start);
+
+    int ret = spi_seq_save_image(table, &image, &image_len);
+    spi_seq_free(table);
+    free(json);
+    if (ret) {
+        printf("Error: Cannot build the image: %s\n", strerror(-ret));
+        return 1;
+    }
+
+    FILE *out = fopen(argv[2], "wb");
+    if (!out || fwrite(image, 1, image_len, out) != image_len || fclose(out)) {
+        printf("Error: Write to %s failed\n", argv[2]);
+        return 1;
+    }
+    printf("%zu byte sequence file, %zu byte image written to %s\n", json_len, image_len, argv[2]);
+
+    if (argc == 4 && reload_device(argv[3], image, image_len))
+        return 1;
+    free(image);
+    return 0;
+}
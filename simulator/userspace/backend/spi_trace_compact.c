@@ -0,0 +1,274 @@
+// Turns a transfer capture (spi_trace_dump output or a spi_recorder file) into a sequence file.
+// Every command that was answered becomes one exact-length sequence, repeated commands are merged
+// and a command that got different answers over time keeps them in order under "responses".
+//
+// gcc -O2 -I../../kernelspace -o spi_trace_compact spi_trace_compact.c
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spi_simulator_ioctl.h"
+
+#define MAX_KEY    256 // Command bytes kept per sequence, later bytes are matched by length only
+#define MAX_RESP   4096
+#define HASH_BITS  16
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME  16777619u
+
+typedef struct {
+    uint8_t *data;
+    uint32_t len;
+} response_t;
+
+typedef struct {
+    uint8_t     key[MAX_KEY];
+    uint32_t    key_len; // Known command bytes
+    uint32_t    length; // Whole command length
+    response_t *resps;
+    uint32_t    nr_resps;
+    uint32_t    cap_resps;
+    int32_t     next; // Hash chain
+} sequence_t;
+
+typedef struct {
+    uint8_t  cmd[MAX_KEY];
+    uint32_t cmd_len; // Known command bytes
+    uint32_t len; // Command bytes written in the frame
+    int      cmd_gap; // Bytes of the command were not captured, cmd stops at the gap
+    uint8_t  resp[MAX_RESP];
+    uint32_t resp_len;
+    int      resp_gap;
+    int      reading; // Read segments since the last write
+} frame_t;
+
+static sequence_t *sequences;
+static uint32_t    nr_sequences;
+static uint32_t    cap_sequences;
+static int32_t     buckets[1 << HASH_BITS];
+static unsigned    truncated;
+static unsigned    unanswered;
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <trace file> <sequence file>\n", program_name);
+    printf("Example: %s boot.bin /tmp/spi_sequences_spidev0.0.json\n", program_name);
+    printf("  Every command answered in the capture becomes an exact sequence. Commands\n");
+    printf("  answered differently over time keep their answers in order (\"responses\").\n");
+}
+
+static uint32_t hash_key(const uint8_t *key, uint32_t key_len, uint32_t length) {
+    uint32_t h = FNV_OFFSET ^ length;
+
+    for (uint32_t i = 0; i < key_len; i++)
+        h = (h ^ key[i]) * FNV_PRIME;
+    return h >> (32 - HASH_BITS);
+}
+
+static sequence_t *find_sequence(const uint8_t *key, uint32_t key_len, uint32_t length) {
+    uint32_t bucket = hash_key(key, key_len, length);
+
+    for (int32_t i = buckets[bucket]; i >= 0; i = sequences[i].next) {
+        sequence_t *seq = &sequences[i];
+
+        if (seq->key_len == key_len && seq->length == length && !memcmp(seq->key, key, key_len))
+            return seq;
+    }
+
+    if (nr_sequences == cap_sequences) {
+        cap_sequences = cap_sequences ? cap_sequences * 2 : 1024;
+        sequences     = realloc(sequences, cap_sequences * sizeof(*sequences));
+        if (!sequences) {
+            printf("Error: Out of memory\n");
+            exit(1);
+        }
+    }
+
+    sequence_t *seq = &sequences[nr_sequences];
+    memset(seq, 0, sizeof(*seq));
+    memcpy(seq->key, key, key_len);
+    seq->key_len     = key_len;
+    seq->length      = length;
+    seq->next        = buckets[bucket];
+    buckets[bucket] = nr_sequences++;
+    return seq;
+}
+
+static void add_response(const uint8_t *key, uint32_t key_len, uint32_t length, const uint8_t *resp,
+                         uint32_t resp_len) {
+    sequence_t *seq = find_sequence(key, key_len, length);
+
+    if (seq->nr_resps == seq->cap_resps) {
+        seq->cap_resps = seq->cap_resps ? seq->cap_resps * 2 : 4;
+        seq->resps     = realloc(seq->resps, seq->cap_resps * sizeof(*seq->resps));
+        if (!seq->resps) {
+            printf("Error: Out of memory\n");
+            exit(1);
+        }
+    }
+
+    response_t *r = &seq->resps[seq->nr_resps++];
+    r->data       = malloc(resp_len ? resp_len : 1);
+    r->len        = resp_len;
+    memcpy(r->data, resp, resp_len);
+}
+
+static void append(uint8_t *dst, uint32_t *dst_len, int *gap, uint32_t cap, const uint8_t *src, uint32_t len) {
+    uint32_t n = len < SPI_SIM_TRACE_DATA ? len : SPI_SIM_TRACE_DATA;
+
+    if (*gap)
+        return;
+    if (n > cap - *dst_len)
+        n = cap - *dst_len;
+    memcpy(dst + *dst_len, src, n);
+    *dst_len += n;
+    // Only the first SPI_SIM_TRACE_DATA bytes of a transfer are captured
+    if (n < len) {
+        *gap = 1;
+        truncated++;
+    }
+}
+
+// The read segments after a write answer the whole command written so far in the frame,
+// as the driver continues the response of the last match.
+static void frame_flush(frame_t *frame) {
+    if (frame->reading && frame->len) {
+        add_response(frame->cmd, frame->cmd_len, frame->len, frame->resp, frame->resp_len);
+    } else if (frame->reading) {
+        unanswered++;
+    }
+    frame->reading  = 0;
+    frame->resp_len = 0;
+    frame->resp_gap = 0;
+}
+
+static void frame_reset(frame_t *frame) {
+    frame_flush(frame);
+    frame->cmd_len = 0;
+    frame->len     = 0;
+    frame->cmd_gap = 0;
+}
+
+static void frame_segment(frame_t *frame, const struct spi_sim_trace_rec *rec) {
+    int tx = rec->flags & SPI_SIM_TRACE_TX;
+    int rx = rec->flags & SPI_SIM_TRACE_RX;
+
+    if (tx && rx) {
+        // Full-duplex segments are commands of their own
+        uint8_t  key[SPI_SIM_TRACE_DATA];
+        uint32_t key_len = 0;
+        uint8_t  resp[SPI_SIM_TRACE_DATA];
+        uint32_t resp_len = 0;
+        int      gap      = 0;
+
+        append(key, &key_len, &gap, sizeof(key), rec->tx, rec->len);
+        gap = 0;
+        append(resp, &resp_len, &gap, sizeof(resp), rec->rx, rec->len);
+        add_response(key, key_len, rec->len, resp, resp_len);
+    } else if (tx) {
+        frame_flush(frame);
+        append(frame->cmd, &frame->cmd_len, &frame->cmd_gap, MAX_KEY, rec->tx, rec->len);
+        frame->len += rec->len;
+    } else if (rx) {
+        append(frame->resp, &frame->resp_len, &frame->resp_gap, MAX_RESP, rec->rx, rec->len);
+        frame->reading = 1;
+    }
+}
+
+static void print_hex(FILE *out, const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++)
+        fprintf(out, i ? " %02X" : "%02X", data[i]);
+}
+
+static int same_response(const response_t *a, const response_t *b) {
+    return a->len == b->len && !memcmp(a->data, b->data, a->len);
+}
+
+static void write_sequence(FILE *out, const sequence_t *seq) {
+    uint32_t nr = seq->nr_resps;
+
+    // The last response repeats once the list runs out, trailing copies of it add nothing
+    while (nr > 1 && same_response(&seq->resps[nr - 1], &seq->resps[nr - 2]))
+        nr--;
+
+    fprintf(out, "  {\"received\": \"");
+    print_hex(out, seq->key, seq->key_len);
+    fprintf(out, "\"");
+    if (seq->length != seq->key_len)
+        fprintf(out, ", \"length\": %u", seq->length);
+    fprintf(out, ", \"match\": \"exact\"");
+
+    if (nr == 1) {
+        fprintf(out, ", \"response\": \"");
+        print_hex(out, seq->resps[0].data, seq->resps[0].len);
+        fprintf(out, "\"}");
+        return;
+    }
+
+    fprintf(out, ", \"responses\": [");
+    for (uint32_t i = 0; i < nr; i++) {
+        fprintf(out, i ? ", \"" : "\"");
+        print_hex(out, seq->resps[i].data, seq->resps[i].len);
+        fprintf(out, "\"");
+    }
+    fprintf(out, "]}");
+}
+
+int main(int argc, char *argv[]) {
+    struct spi_sim_trace_rec rec;
+    frame_t                  frame   = {0};
+    unsigned long long       records = 0;
+    unsigned long long       lost    = 0;
+
+    if (argc != 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        printf("Error: Cannot open %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    memset(buckets, 0xff, sizeof(buckets));
+    while (fread(&rec, sizeof(rec), 1, in) == 1) {
+        if (rec.flags & SPI_SIM_TRACE_LOST) {
+            lost += rec.len;
+            frame_reset(&frame);
+            continue;
+        }
+        if (!(rec.flags & SPI_SIM_TRACE_CONT))
+            frame_reset(&frame);
+        frame_segment(&frame, &rec);
+        records++;
+    }
+    frame_reset(&frame);
+    fclose(in);
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        printf("Error: Cannot create %s: %s\n", argv[2], strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "[\n");
+    for (uint32_t i = 0; i < nr_sequences; i++) {
+        write_sequence(out, &sequences[i]);
+        fprintf(out, i + 1 < nr_sequences ? ",\n" : "\n");
+    }
+    fprintf(out, "]\n");
+    if (fclose(out)) {
+        printf("Error: Write to %s failed\n", argv[2]);
+        return 1;
+    }
+
+    printf("%llu transfers, %u sequences written to %s\n", records, nr_sequences, argv[2]);
+    if (lost)
+        printf("Warning: %llu transfers were lost while capturing, ordered responses may be incomplete\n", lost);
+    if (truncated)
+        printf("Warning: %u transfers were longer than the %d captured bytes, their tails were not replayed\n",
+               truncated, SPI_SIM_TRACE_DATA);
+    if (unanswered)
+        printf("Warning: %u reads without a command were skipped\n", unanswered);
+    return 0;
+}
@@ -1,6 +1,6 @@
 import { useState, useRef, useEffect } from 'react'
 import { Button } from './components/ui/button'
-import { Trash2, Download, Upload, Github, Terminal, Server, Monitor, Cpu, Copy, HelpCircle } from 'lucide-react'
+import { Trash2, Download, Upload, Github, Terminal, Server, Monitor, Cpu, Copy, HelpCircle, Activity } from 'lucide-react'
 import { Tooltip, TooltipContent, TooltipProvider, TooltipTrigger } from './components/ui/tooltip'
 import toast, { Toaster } from 'react-hot-toast'
 
@@ -23,6 +23,42 @@ interface Log {
   timestamp: string
 }
 
+interface Transfer {
+  type: 'transfer'
+  device: string
+  ts_ns: number
+  len: number
+  speed_hz: number
+  mode: number
+  seq: number | null
+  cont: boolean
+  tx: string | null
+  rx: string | null
+}
+
+// Events of /api/stream, sent in batches
+type StreamEvent =
+  | { type: 'log'; message: string }
+  | Transfer
+  | { type: 'lost'; device: string; ts_ns: number; count: number }
+  | { type: 'stats'; device: string; counters: Record<string, number>; delta: Record<string, number> }
+  | { type: 'status'; status: SystemStatus }
+
+interface StreamBatch {
+  events: StreamEvent[]
+  dropped: number
+}
+
+interface TransferStats {
+  transfers: number
+  lost: number
+  dropped: number
+  counters: Record<string, Record<string, number>>
+}
+
+// Terminal shows only the latest lines, the counters keep the totals
+const TERMINAL_LINES = 1000
+
 interface SystemStatus {
   backend: {
     status: boolean;
@@ -56,6 +92,8 @@ function App() {
   const [newResponse, setNewResponse] = useState('')
   const [logList, setLogList] = useState<Log[]>([])
   const [lastLogId, setLastLogId] = useState<number>(0)
+  const [transferStats, setTransferStats] = useState<TransferStats>({ transfers: 0, lost: 0, dropped: 0, counters: {} })
+  const nextLineId = useRef(0)
   const fileInputRef = useRef<HTMLInputElement>(null)
   const terminalRef = useRef<HTMLDivElement>(null);
   const [systemStatus, setSystemStatus] = useState<SystemStatus>({
@@ -332,26 +370,6 @@ function App() {
     reader.readAsText(file)
   }
 
-  // Log'ları kontrol et
-  const checkLogs = async () => {
-    try {
-      const response = await fetch('http://localhost:5001/api/spi/logs');
-      const data = await response.json();
-      
-      if (data.status === 'success') {
-        const newLogs = data.logs.map((log: string, index: number) => ({
-          id: Date.now() + index,
-          message: log,
-          timestamp: new Date().toLocaleTimeString()
-        }));
-        
-        setLogList(newLogs);
-      }
-    } catch (error) {
-      console.error('Error checking logs:', error);
-    }
-  };
-
   // Terminal'i temizle
   const clearTerminal = async () => {
     try {
@@ -376,46 +394,82 @@ function App() {
     }
   };
 
-  // Periyodik olarak log'ları kontrol et
-  useEffect(() => {
-    const interval = setInterval(checkLogs, 1000);
-    return () => clearInterval(interval);
-  }, []);
+  const transferLine = (transfer: Transfer) =>
+    `[${transfer.device}] ${transfer.cont ? '+' : ''}${transfer.len}B` +
+    `${transfer.tx ? ` > ${transfer.tx}` : ''}${transfer.rx ? ` < ${transfer.rx}` : ''}` +
+    `${transfer.seq !== null ? ` (seq ${transfer.seq})` : ''}`;
 
-  // Terminal'i en son satıra scroll et
+  // Backend olaylarını dinle: loglar, transferler, sayaçlar ve durum, tek bağlantı üzerinden
   useEffect(() => {
-    if (terminalRef.current) {
-      terminalRef.current.scrollTop = terminalRef.current.scrollHeight;
-    }
-  }, [logList, commandList]); // logList veya commandList değiştiğinde scroll et
+    const source = new EventSource('http://localhost:5001/api/stream');
+
+    source.onmessage = (message) => {
+      const batch: StreamBatch = JSON.parse(message.data);
+      const timestamp = new Date().toLocaleTimeString();
+      const lines: Log[] = [];
+      let transfers = 0;
+      let lost = 0;
+      let status: SystemStatus | null = null;
+      const counters: Record<string, Record<string, number>> = {};
+
+      for (const event of batch.events) {
+        if (event.type === 'log') {
+          lines.push({ id: nextLineId.current++, message: event.message, timestamp });
+        } else if (event.type === 'transfer') {
+          transfers++;
+          lines.push({ id: nextLineId.current++, message: transferLine(event), timestamp });
+        } else if (event.type === 'lost') {
+          lost += event.count;
+          lines.push({ id: nextLineId.current++, message: `[${event.device}] ${event.count} transfers lost`, timestamp });
+        } else if (event.type === 'stats') {
+          counters[event.device] = event.counters;
+        } else if (event.type === 'status') {
+          status = event.status;
+        }
+      }
 
-  // Check system status
-  const checkSystemStatus = async () => {
-    try {
-      const response = await fetch('http://localhost:5001/api/system/status');
-      const data = await response.json();
-      
-      if (data.status === 'success') {
-        const newStatus = data.data;
+      // Bir batch tek render
+      if (lines.length) {
+        setLogList(prev => [...prev, ...lines].slice(-TERMINAL_LINES));
+      }
+      if (transfers || lost || batch.dropped || Object.keys(counters).length) {
+        setTransferStats(prev => ({
+          transfers: prev.transfers + transfers,
+          lost: prev.lost + lost,
+          dropped: prev.dropped + batch.dropped,
+          counters: { ...prev.counters, ...counters }
+        }));
+      }
+      if (status) {
+        const newStatus: SystemStatus = status;
         setSystemStatus(newStatus);
         // Driver durumunu kontrol et ve isRunning state'ini güncelle
-        if (!newStatus.driver.status && isRunning) {
+        if (!newStatus.driver.status) {
           setIsRunning(false);
         }
       }
-    } catch (error) {
-      console.error('Error checking system status:', error);
-    }
-  };
+    };
 
-  // Periodically check system status
-  useEffect(() => {
-    const interval = setInterval(checkSystemStatus, 2000);
-    // Initial check
-    checkSystemStatus();
-    return () => clearInterval(interval);
+    // Backend her bağlantıda tampondaki logları yeniden gönderir
+    source.onopen = () => {
+      setLogList([]);
+    };
+
+    // EventSource kendisi yeniden bağlanır, bu sırada backend kapalı görünür
+    source.onerror = () => {
+      setSystemStatus(prev => ({ ...prev, backend: { ...prev.backend, status: false } }));
+    };
+
+    return () => source.close();
   }, []);
 
+  // Terminal'i en son satıra scroll et
+  useEffect(() => {
+    if (terminalRef.current) {
+      terminalRef.current.scrollTop = terminalRef.current.scrollHeight;
+    }
+  }, [logList, commandList]); // logList veya commandList değiştiğinde scroll et
+
   // Terminal içeriğini kopyala
   const copyTerminalContent = () => {
     const content = logList.map(log => log.message).join('\n');
@@ -504,6 +558,25 @@ function App() {
                     <p>SPI Driver {systemStatus.driver.status ? 'is loaded' : 'is not loaded'}</p>
                   </TooltipContent>
                 </Tooltip>
+
+                <Tooltip>
+                  <TooltipTrigger asChild>
+                    <div className="flex items-center gap-2">
+                      <Activity className={`h-4 w-4 ${transferStats.lost || transferStats.dropped ? 'text-yellow-500' : 'text-gray-500'}`} />
+                      <span className="text-xs text-gray-700">
+                        Transfers ({transferStats.transfers})
+                      </span>
+                    </div>
+                  </TooltipTrigger>
+                  <TooltipContent>
+                    <p>{transferStats.transfers} transfers streamed, {transferStats.lost} lost by the driver, {transferStats.dropped} events dropped by the backend</p>
+                    {Object.entries(transferStats.counters).map(([device, counters]) => (
+                      <p key={device}>
+                        {device}: {Object.entries(counters).map(([name, value]) => `${name} ${value}`).join(', ')}
+                      </p>
+                    ))}
+                  </TooltipContent>
+                </Tooltip>
               </TooltipProvider>
             </div>
           </div>
@@ -11,6 +11,9 @@
 /// @param device SPI device path
 /// @return If the operation is successful, return 0. Otherwise, return -1
 int spi_init(spi_config_t *self) {
+    self->scratch      = NULL;
+    self->scratch_size = 0;
+
     self->spidev_fd = open(self->device, O_RDWR);
     if (self->spidev_fd < 0) {
         printf("    Error! Can't open device! (fn: %s)\n", __func__);
@@ -57,6 +60,9 @@ int spi_deinit(spi_config_t *self) {
     }
 
     close(self->spidev_fd);
+    free(self->scratch);
+    self->scratch      = NULL;
+    self->scratch_size = 0;
     return 0;
 }
 
@@ -194,6 +200,30 @@ int spi_read(spi_config_t *self, uint8_t *buffer, uint16_t length) {
     return 0;
 }
 
+/// @brief Make sure both scratch halves hold at least length bytes, growing in powers of two
+/// @param length Required size of each half
+/// @return If the operation is successful, return 0. Otherwise, return -1
+static int spi_reserve_scratch(spi_config_t *self, uint32_t length) {
+    if (length <= self->scratch_size) {
+        return 0;
+    }
+
+    uint32_t size = self->scratch_size ? self->scratch_size : 64;
+    while (size < length) {
+        size *= 2;
+    }
+
+    uint8_t *scratch = realloc(self->scratch, 2 * (size_t) size);
+    if (!scratch) {
+        printf("    Error! Memory allocation failed. (fn: %s)\n", __func__);
+        return -1;
+    }
+
+    self->scratch      = scratch;
+    self->scratch_size = size;
+    return 0;
+}
+
 /// @brief Transfer data to the SPI device
 /// @param tx_data Data to be written (can be NULL if only reading)
 /// @param rx_data Data to be read (can be NULL if only writing)
@@ -207,20 +237,20 @@ int spi_transfer(spi_config_t *self, const uint8_t *tx_buffer, uint16_t tx_lengt
         return -1;
     }
 
-    // Tek bir transfer içinde hem write hem read yapıyoruz
-    uint16_t total_length   = tx_length + rx_length;
-    uint8_t *full_tx_buffer = calloc(total_length, sizeof(uint8_t));
-    uint8_t *full_rx_buffer = calloc(total_length, sizeof(uint8_t));
-
-    if (!full_tx_buffer || !full_rx_buffer) {
-        printf("    Error! Memory allocation failed. (fn: %s)\n", __func__);
-        free(full_tx_buffer);
-        free(full_rx_buffer);
+    // Tek bir transfer içinde hem write hem read yapıyoruz, tamponlar çağrılar arasında tekrar kullanılır
+    uint32_t total_length = tx_length + rx_length;
+    if (spi_reserve_scratch(self, total_length) < 0) {
         return -1;
     }
 
+    uint8_t *full_tx_buffer = self->scratch;
+    uint8_t *full_rx_buffer = self->scratch + self->scratch_size;
+
     // TX buffer'ı kopyala, geri kalanı 0 (dummy bytes)
-    memcpy(full_tx_buffer, tx_buffer, tx_length);
+    if (tx_length) {
+        memcpy(full_tx_buffer, tx_buffer, tx_length);
+    }
+    memset(full_tx_buffer + tx_length, 0, rx_length);
 
     struct spi_ioc_transfer xfer = {.tx_buf        = (unsigned long) full_tx_buffer,
                                     .rx_buf        = (unsigned long) full_rx_buffer,
@@ -232,15 +262,194 @@ int spi_transfer(spi_config_t *self, const uint8_t *tx_buffer, uint16_t tx_lengt
 
     if (ioctl(self->spidev_fd, SPI_IOC_MESSAGE(1), &xfer) < 0) {
         printf("    Error! SPI_IOC_MESSAGE failed. (fn: %s)\n", __func__);
-        free(full_tx_buffer);
-        free(full_rx_buffer);
         return -1;
     }
 
     // RX data'yı kopyala (ilk rx_length byte'ı al)
-    memcpy(rx_buffer, full_rx_buffer, rx_length);
+    if (rx_length) {
+        memcpy(rx_buffer, full_rx_buffer, rx_length);
+    }
+
+    return 0;
+}
+
+/// @brief Transfer caller owned buffers as the segments of one chip select frame, without copying
+/// @param iov Segments to transfer
+/// @param count Number of segments, at most SPI_IOV_MAX
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_transfer_iov(spi_config_t *self, const spi_iov_t *iov, int count) {
+    if (self->spidev_fd < 0) {
+        printf("    Error! SPI device is not initialized. (fn: %s)\n", __func__);
+        return -1;
+    }
+
+    if (count <= 0 || count > SPI_IOV_MAX) {
+        printf("    Error! Segment count must be 1..%d. (fn: %s)\n", SPI_IOV_MAX, __func__);
+        return -1;
+    }
+
+    struct spi_ioc_transfer xfers[SPI_IOV_MAX];
+    memset(xfers, 0, count * sizeof(xfers[0]));
+    for (int i = 0; i < count; i++) {
+        xfers[i].tx_buf        = (unsigned long) iov[i].tx_buffer;
+        xfers[i].rx_buf        = (unsigned long) iov[i].rx_buffer;
+        xfers[i].len           = iov[i].length;
+        xfers[i].speed_hz      = self->speed;
+        xfers[i].bits_per_word = self->bits;
+    }
+
+    if (ioctl(self->spidev_fd, SPI_IOC_MESSAGE(count), xfers) < 0) {
+        printf("    Error! SPI_IOC_MESSAGE failed. (fn: %s)\n", __func__);
+        return -1;
+    }
+
+    return 0;
+}
+
+/// @brief Transfer many full-duplex frames, each segment releases chip select after itself.
+/// Frames are packed back to back in both buffers and sent SPI_BATCH_XFERS per ioctl.
+/// @param tx_buffer Data of all frames to be written
+/// @param rx_buffer Buffer for the data of all frames to be read, as large as tx_buffer
+/// @param lengths Size of every frame
+/// @param count Number of frames
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_transfer_batch(spi_config_t *self, const uint8_t *tx_buffer, uint8_t *rx_buffer, const uint32_t *lengths,
+                       uint32_t count) {
+    if (self->spidev_fd < 0) {
+        printf("    Error! SPI device is not initialized. (fn: %s)\n", __func__);
+        return -1;
+    }
+
+    struct spi_ioc_transfer xfers[SPI_BATCH_XFERS];
+    size_t                  off = 0;
+
+    for (uint32_t done = 0; done < count;) {
+        uint32_t n = count - done < SPI_BATCH_XFERS ? count - done : SPI_BATCH_XFERS;
+
+        memset(xfers, 0, n * sizeof(xfers[0]));
+        for (uint32_t i = 0; i < n; i++) {
+            xfers[i].tx_buf        = (unsigned long) (tx_buffer + off);
+            xfers[i].rx_buf        = (unsigned long) (rx_buffer + off);
+            xfers[i].len           = lengths[done + i];
+            // Every command is its own frame, the message end releases CS after the last one
+            xfers[i].cs_change     = i + 1 < n;
+            xfers[i].speed_hz      = self->speed;
+            xfers[i].bits_per_word = self->bits;
+            off += lengths[done + i];
+        }
+
+        if (ioctl(self->spidev_fd, SPI_IOC_MESSAGE(n), xfers) < 0) {
+            printf("    Error! SPI_IOC_MESSAGE failed after %u frames. (fn: %s)\n", done, __func__);
+            return -1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+//---------------------------------------------------------------------------
+// Transaction functions
+//---------------------------------------------------------------------------
+
+/// @brief Start an empty transaction on the SPI device
+/// @param transaction Transaction to initialize
+void spi_transaction_begin(spi_config_t *self, spi_transaction_t *transaction) {
+    transaction->spi   = self;
+    transaction->count = 0;
+}
+
+/// @brief Queue a segment, the buffers must stay valid until the transaction is submitted
+/// @return If the operation is successful, return 0. Otherwise, return -1
+static int spi_transaction_add(spi_transaction_t *transaction, const uint8_t *tx_buffer, uint8_t *rx_buffer,
+                               uint32_t length) {
+    if (transaction->count >= SPI_TRANSACTION_MAX) {
+        printf("    Error! Transaction is full (%d segments). (fn: %s)\n", SPI_TRANSACTION_MAX, __func__);
+        return -1;
+    }
+
+    struct spi_ioc_transfer *xfer = &transaction->xfers[transaction->count++];
+    memset(xfer, 0, sizeof(*xfer));
+    xfer->tx_buf        = (unsigned long) tx_buffer;
+    xfer->rx_buf        = (unsigned long) rx_buffer;
+    xfer->len           = length;
+    xfer->speed_hz      = transaction->spi->speed;
+    xfer->bits_per_word = transaction->spi->bits;
+    return 0;
+}
+
+/// @brief Queue a write segment
+/// @param buffer Data to be written
+/// @param length Data size
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_transaction_write(spi_transaction_t *transaction, const uint8_t *buffer, uint32_t length) {
+    return spi_transaction_add(transaction, buffer, NULL, length);
+}
+
+/// @brief Queue a read segment
+/// @param buffer Buffer for the data to be read
+/// @param length Data size
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_transaction_read(spi_transaction_t *transaction, uint8_t *buffer, uint32_t length) {
+    return spi_transaction_add(transaction, NULL, buffer, length);
+}
+
+/// @brief Queue a full-duplex segment
+/// @param tx_buffer Data to be written
+/// @param rx_buffer Buffer for the data to be read
+/// @param length Data size of both buffers
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_transaction_transfer(spi_transaction_t *transaction, const uint8_t *tx_buffer, uint8_t *rx_buffer,
+                             uint32_t length) {
+    return spi_transaction_add(transaction, tx_buffer, rx_buffer, length);
+}
+
+/// @brief Wait after the last queued segment
+/// @param usecs Delay in microseconds
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_transaction_delay(spi_transaction_t *transaction, uint16_t usecs) {
+    if (transaction->count == 0) {
+        printf("    Error! No segment to delay after. (fn: %s)\n", __func__);
+        return -1;
+    }
+
+    transaction->xfers[transaction->count - 1].delay_usecs = usecs;
+    return 0;
+}
+
+/// @brief Release chip select after the last queued segment, the next segment starts a new frame.
+/// On the final segment of a transaction spidev keeps chip select asserted instead.
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_transaction_cs_change(spi_transaction_t *transaction) {
+    if (transaction->count == 0) {
+        printf("    Error! No segment to end the frame after. (fn: %s)\n", __func__);
+        return -1;
+    }
+
+    transaction->xfers[transaction->count - 1].cs_change = 1;
+    return 0;
+}
+
+/// @brief Submit all queued segments with a single ioctl and empty the transaction
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_transaction_submit(spi_transaction_t *transaction) {
+    spi_config_t *self  = transaction->spi;
+    int           count = transaction->count;
+
+    if (self->spidev_fd < 0) {
+        printf("    Error! SPI device is not initialized. (fn: %s)\n", __func__);
+        return -1;
+    }
+
+    transaction->count = 0;
+    if (count == 0) {
+        return 0;
+    }
+
+    if (ioctl(self->spidev_fd, SPI_IOC_MESSAGE(count), transaction->xfers) < 0) {
+        printf("    Error! SPI_IOC_MESSAGE failed. (fn: %s)\n", __func__);
+        return -1;
+    }
 
-    free(full_tx_buffer);
-    free(full_rx_buffer);
     return 0;
 }
@@ -20,8 +20,31 @@ typedef struct {
     uint16_t delay;
     uint32_t lsb;
     char     *device;
+    uint8_t  *scratch;      // TX half then RX half, reused by spi_transfer
+    uint32_t scratch_size;  // Size of each half
 } spi_config_t;
 
+// One segment of an iovec-style transfer, the caller owns the buffers
+typedef struct {
+    const uint8_t *tx_buffer; // NULL clocks out zeros
+    uint8_t       *rx_buffer; // NULL discards the received bytes
+    uint32_t       length;
+} spi_iov_t;
+
+#define SPI_IOV_MAX 32
+
+// Segments queued for a single SPI_IOC_MESSAGE(N) ioctl
+#define SPI_TRANSACTION_MAX 32
+
+typedef struct {
+    spi_config_t           *spi;
+    struct spi_ioc_transfer xfers[SPI_TRANSACTION_MAX];
+    int                     count;
+} spi_transaction_t;
+
+// Frames per SPI_IOC_MESSAGE(N) ioctl of spi_transfer_batch, _IOC_SIZE limits N to 511
+#define SPI_BATCH_XFERS 256
+
 //---------------------------------------------------------------------------
 // Open/Close Functions
 //---------------------------------------------------------------------------
@@ -42,5 +65,20 @@ int spi_set_lsb(spi_config_t *self, uint32_t lsb);
 int spi_write(spi_config_t *self, uint8_t *buffer, uint16_t length);
 int spi_read(spi_config_t *self, uint8_t *buffer, uint16_t length);
 int spi_transfer(spi_config_t *self, const uint8_t *tx_buffer, uint16_t tx_length, uint8_t *rx_buffer, uint16_t rx_length);
+int spi_transfer_iov(spi_config_t *self, const spi_iov_t *iov, int count);
+int spi_transfer_batch(spi_config_t *self, const uint8_t *tx_buffer, uint8_t *rx_buffer, const uint32_t *lengths,
+                       uint32_t count);
+
+//---------------------------------------------------------------------------
+// Transaction functions
+//---------------------------------------------------------------------------
+void spi_transaction_begin(spi_config_t *self, spi_transaction_t *transaction);
+int  spi_transaction_write(spi_transaction_t *transaction, const uint8_t *buffer, uint32_t length);
+int  spi_transaction_read(spi_transaction_t *transaction, uint8_t *buffer, uint32_t length);
+int  spi_transaction_transfer(spi_transaction_t *transaction, const uint8_t *tx_buffer, uint8_t *rx_buffer,
+                              uint32_t length);
+int  spi_transaction_delay(spi_transaction_t *transaction, uint16_t usecs);
+int  spi_transaction_cs_change(spi_transaction_t *transaction);
+int  spi_transaction_submit(spi_transaction_t *transaction);
 
 #endif //LINUX_SPI_H
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "spi_async.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+//---------------------------------------------------------------------------
+// Open/Close Functions
+//---------------------------------------------------------------------------
+
+/// @brief Create the io_uring instance and map its queues
+/// @param entries Submission queue size, the completion queue is twice as large
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_async_init(spi_async_t *self, unsigned entries) {
+    struct io_uring_params params;
+
+    memset(self, 0, sizeof(*self));
+    memset(&params, 0, sizeof(params));
+
+    self->ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (self->ring_fd < 0) {
+        printf("    Error! io_uring_setup failed: %s (fn: %s)\n", strerror(errno), __func__);
+        return -1;
+    }
+
+    self->sq_entries   = params.sq_entries;
+    self->cq_entries   = params.cq_entries;
+    self->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    self->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    self->sqes_size    = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Both rings share one mapping on kernels with IORING_FEAT_SINGLE_MMAP
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (self->cq_ring_size > self->sq_ring_size) {
+            self->sq_ring_size = self->cq_ring_size;
+        }
+        self->cq_ring_size = self->sq_ring_size;
+    }
+
+    self->sq_ring = mmap(NULL, self->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, self->ring_fd,
+                         IORING_OFF_SQ_RING);
+    if (self->sq_ring == MAP_FAILED) {
+        printf("    Error! Can't map the submission ring. (fn: %s)\n", __func__);
+        close(self->ring_fd);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        self->cq_ring = self->sq_ring;
+    } else {
+        self->cq_ring = mmap(NULL, self->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             self->ring_fd, IORING_OFF_CQ_RING);
+        if (self->cq_ring == MAP_FAILED) {
+            printf("    Error! Can't map the completion ring. (fn: %s)\n", __func__);
+            munmap(self->sq_ring, self->sq_ring_size);
+            close(self->ring_fd);
+            return -1;
+        }
+    }
+
+    self->sqes = mmap(NULL, self->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, self->ring_fd,
+                      IORING_OFF_SQES);
+    if (self->sqes == MAP_FAILED) {
+        printf("    Error! Can't map the submission entries. (fn: %s)\n", __func__);
+        if (self->cq_ring != self->sq_ring) {
+            munmap(self->cq_ring, self->cq_ring_size);
+        }
+        munmap(self->sq_ring, self->sq_ring_size);
+        close(self->ring_fd);
+        return -1;
+    }
+
+    self->sq_head  = (unsigned *) ((char *) self->sq_ring + params.sq_off.head);
+    self->sq_tail  = (unsigned *) ((char *) self->sq_ring + params.sq_off.tail);
+    self->sq_mask  = (unsigned *) ((char *) self->sq_ring + params.sq_off.ring_mask);
+    self->sq_array = (unsigned *) ((char *) self->sq_ring + params.sq_off.array);
+    self->cq_head  = (unsigned *) ((char *) self->cq_ring + params.cq_off.head);
+    self->cq_tail  = (unsigned *) ((char *) self->cq_ring + params.cq_off.tail);
+    self->cq_mask  = (unsigned *) ((char *) self->cq_ring + params.cq_off.ring_mask);
+    self->cqes     = (struct io_uring_cqe *) ((char *) self->cq_ring + params.cq_off.cqes);
+    return 0;
+}
+
+/// @brief Unmap the queues and close the io_uring instance
+void spi_async_deinit(spi_async_t *self) {
+    if (self->ring_fd < 0) {
+        return;
+    }
+
+    munmap(self->sqes, self->sqes_size);
+    if (self->cq_ring != self->sq_ring) {
+        munmap(self->cq_ring, self->cq_ring_size);
+    }
+    munmap(self->sq_ring, self->sq_ring_size);
+    close(self->ring_fd);
+    self->ring_fd = -1;
+}
+
+//---------------------------------------------------------------------------
+// Submission/Completion Functions
+//---------------------------------------------------------------------------
+
+/// @brief Queue a SPI message, the transfers and their buffers must stay valid until it completes
+/// @param spidev_fd Simulator device file
+/// @param xfers Segments of the message, as for SPI_IOC_MESSAGE(count)
+/// @param count Number of segments
+/// @param user_data Value returned with the completion
+/// @return If the operation is successful, return 0. If the queue is full, return -1
+int spi_async_queue(spi_async_t *self, int spidev_fd, const struct spi_ioc_transfer *xfers, unsigned count,
+                    uint64_t user_data) {
+    unsigned tail = *self->sq_tail + self->queued;
+    unsigned head = __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE);
+
+    // Keep room for every completion so the completion queue never overflows
+    if (tail - head >= self->sq_entries || self->queued + self->in_flight >= self->cq_entries) {
+        return -1;
+    }
+
+    unsigned                 index = tail & *self->sq_mask;
+    struct io_uring_sqe     *sqe   = &self->sqes[index];
+    struct spi_sim_uring_msg msg   = {.xfers = (uintptr_t) xfers, .n_xfers = count};
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_URING_CMD;
+    sqe->fd        = spidev_fd;
+    sqe->cmd_op    = SPI_SIM_URING_MESSAGE;
+    sqe->user_data = user_data;
+    memcpy(sqe->cmd, &msg, sizeof(msg));
+
+    self->sq_array[index] = index;
+    self->queued++;
+    return 0;
+}
+
+/// @brief Submit the queued messages with one system call
+/// @param wait_nr Number of completions to wait for, 0 returns right away
+/// @return The number of submitted messages, or -1 on error
+int spi_async_submit(spi_async_t *self, unsigned wait_nr) {
+    unsigned to_submit = self->queued;
+
+    // Entries published to the ring are in flight even if the kernel consumes them on a later call
+    __atomic_store_n(self->sq_tail, *self->sq_tail + to_submit, __ATOMIC_RELEASE);
+    self->queued = 0;
+    self->in_flight += to_submit;
+
+    int ret = syscall(__NR_io_uring_enter, self->ring_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0,
+                      NULL, 0);
+    if (ret < 0) {
+        printf("    Error! io_uring_enter failed: %s (fn: %s)\n", strerror(errno), __func__);
+        return -1;
+    }
+
+    return ret;
+}
+
+/// @brief Collect finished messages without blocking
+/// @param completions Array receiving the completions
+/// @param max Size of the array
+/// @return The number of completions stored
+int spi_async_reap(spi_async_t *self, spi_async_completion_t *completions, int max) {
+    unsigned head = *self->cq_head;
+    unsigned tail = __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE);
+    int      n    = 0;
+
+    while (head != tail && n < max) {
+        struct io_uring_cqe *cqe = &self->cqes[head & *self->cq_mask];
+
+        completions[n].user_data = cqe->user_data;
+        completions[n].result    = cqe->res;
+        n++;
+        head++;
+    }
+
+    __atomic_store_n(self->cq_head, head, __ATOMIC_RELEASE);
+    self->in_flight -= n;
+    return n;
+}
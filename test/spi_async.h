@@ -0,0 +1,56 @@
+#ifndef SPI_ASYNC_H
+#define SPI_ASYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <linux/spi/spidev.h>
+#include "spi_simulator_ioctl.h"
+
+
+// io_uring instance that queues SPI messages to any number of simulator fds
+typedef struct {
+    int                  ring_fd;
+    unsigned             sq_entries;
+    unsigned             cq_entries;
+    // Submission queue
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    struct io_uring_sqe *sqes;
+    // Completion queue
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_cqe *cqes;
+    // Mappings
+    void                *sq_ring;
+    size_t               sq_ring_size;
+    void                *cq_ring;
+    size_t               cq_ring_size;
+    size_t               sqes_size;
+    unsigned             queued; // Queued, not yet submitted
+    unsigned             in_flight; // Submitted, completion not reaped yet
+} spi_async_t;
+
+typedef struct {
+    uint64_t user_data;
+    int      result; // SPI_IOC_MESSAGE return value or -errno
+} spi_async_completion_t;
+
+//---------------------------------------------------------------------------
+// Open/Close Functions
+//---------------------------------------------------------------------------
+int  spi_async_init(spi_async_t *self, unsigned entries);
+void spi_async_deinit(spi_async_t *self);
+
+//---------------------------------------------------------------------------
+// Submission/Completion Functions
+//---------------------------------------------------------------------------
+int spi_async_queue(spi_async_t *self, int spidev_fd, const struct spi_ioc_transfer *xfers, unsigned count,
+                    uint64_t user_data);
+int spi_async_submit(spi_async_t *self, unsigned wait_nr);
+int spi_async_reap(spi_async_t *self, spi_async_completion_t *completions, int max);
+
+#endif //SPI_ASYNC_H
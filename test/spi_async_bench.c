@@ -0,0 +1,213 @@
+#include "spi_async.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_DEVICES  64
+#define MAX_DEPTH    64
+#define MAX_CMD_SIZE 256
+
+typedef struct {
+    const char *device_path;
+    double      duration;
+    uint64_t    transfers;
+    int         error;
+} worker_t;
+
+static uint8_t command[MAX_CMD_SIZE];
+static int     command_len;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <command> <seconds> <depth> <device> [device...]\n", program_name);
+    printf("Example: %s \"9F 00 00 00\" 2 16 /dev/spidev0.0 /dev/spidev0.1\n", program_name);
+    printf("  Runs full-duplex transfers of <command> on every device with one blocking thread per\n");
+    printf("  device, then from a single thread through io_uring with <depth> messages in flight per\n");
+    printf("  device, and prints the total transfers/sec of both.\n");
+}
+
+static int parse_command(const char *str, uint8_t *out) {
+    int len = 0;
+
+    while (*str) {
+        char *end;
+        long  val = strtol(str, &end, 16);
+        if (end == str)
+            break;
+        if (len >= MAX_CMD_SIZE || val < 0 || val > 0xFF)
+            return -1;
+        out[len++] = (uint8_t) val;
+        str        = end;
+    }
+    return len;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *self = arg;
+    uint8_t   rx_buffer[MAX_CMD_SIZE];
+
+    int fd = open(self->device_path, O_RDWR);
+    if (fd < 0) {
+        printf("Error: Cannot open device %s: %s\n", self->device_path, strerror(errno));
+        self->error = 1;
+        return NULL;
+    }
+
+    struct spi_ioc_transfer tr = {
+            .tx_buf = (unsigned long) command, .rx_buf = (unsigned long) rx_buffer, .len = command_len};
+
+    double end_time = now_seconds() + self->duration;
+    while (now_seconds() < end_time) {
+        for (int i = 0; i < 256; i++) {
+            if (ioctl(fd, SPI_IOC_MESSAGE(1), &tr) < 0) {
+                printf("Error: SPI transfer failed: %s\n", strerror(errno));
+                self->error = 1;
+                close(fd);
+                return NULL;
+            }
+        }
+        self->transfers += 256;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+// One blocking thread per device
+static double run_threads(char **devices, int nr_devices, double duration) {
+    static worker_t  workers[MAX_DEVICES];
+    static pthread_t threads[MAX_DEVICES];
+    uint64_t         total = 0;
+    int              error = 0;
+
+    double start = now_seconds();
+    for (int i = 0; i < nr_devices; i++) {
+        memset(&workers[i], 0, sizeof(workers[i]));
+        workers[i].device_path = devices[i];
+        workers[i].duration    = duration;
+        pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    }
+    for (int i = 0; i < nr_devices; i++) {
+        pthread_join(threads[i], NULL);
+        total += workers[i].transfers;
+        error |= workers[i].error;
+    }
+
+    return error ? -1 : total / (now_seconds() - start);
+}
+
+// A single thread keeps depth messages in flight on every device
+static double run_async(char **devices, int nr_devices, int depth, double duration) {
+    static struct spi_ioc_transfer xfers[MAX_DEVICES * MAX_DEPTH];
+    static uint8_t                 rx_buffers[MAX_DEVICES * MAX_DEPTH][MAX_CMD_SIZE];
+    static spi_async_completion_t  completions[MAX_DEVICES * MAX_DEPTH];
+    int                            fds[MAX_DEVICES];
+    int                            nr_slots = nr_devices * depth;
+    uint64_t                       total    = 0;
+    double                         result   = -1;
+    spi_async_t                    ring;
+
+    if (spi_async_init(&ring, nr_slots) < 0) {
+        return -1;
+    }
+
+    int opened = 0;
+    for (; opened < nr_devices; opened++) {
+        fds[opened] = open(devices[opened], O_RDWR);
+        if (fds[opened] < 0) {
+            printf("Error: Cannot open device %s: %s\n", devices[opened], strerror(errno));
+            goto out;
+        }
+    }
+
+    // Every slot has its own descriptor and receive buffer, user_data is the slot index
+    for (int slot = 0; slot < nr_slots; slot++) {
+        memset(&xfers[slot], 0, sizeof(xfers[slot]));
+        xfers[slot].tx_buf = (unsigned long) command;
+        xfers[slot].rx_buf = (unsigned long) rx_buffers[slot];
+        xfers[slot].len    = command_len;
+        spi_async_queue(&ring, fds[slot / depth], &xfers[slot], 1, slot);
+    }
+
+    double start    = now_seconds();
+    double end_time = start + duration;
+    while (1) {
+        if (spi_async_submit(&ring, 1) < 0) {
+            goto out;
+        }
+
+        int n = spi_async_reap(&ring, completions, nr_slots);
+        for (int i = 0; i < n; i++) {
+            int slot = completions[i].user_data;
+            if (completions[i].result < 0) {
+                printf("Error: SPI transfer failed: %s\n", strerror(-completions[i].result));
+                goto out;
+            }
+            total++;
+            if (now_seconds() < end_time) {
+                spi_async_queue(&ring, fds[slot / depth], &xfers[slot], 1, slot);
+            }
+        }
+
+        if (ring.in_flight == 0 && ring.queued == 0) {
+            break;
+        }
+    }
+    result = total / (now_seconds() - start);
+
+out:
+    // Drain what is still in flight before the buffers go away
+    while (ring.in_flight > 0 && spi_async_submit(&ring, 1) >= 0) {
+        spi_async_reap(&ring, completions, nr_slots);
+    }
+    for (int i = 0; i < opened; i++) {
+        close(fds[i]);
+    }
+    spi_async_deinit(&ring);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 5) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    double duration   = atof(argv[2]);
+    int    depth      = atoi(argv[3]);
+    int    nr_devices = argc - 4;
+
+    command_len = parse_command(argv[1], command);
+    if (command_len <= 0) {
+        printf("Error: Invalid command, use space separated hex bytes\n");
+        return 1;
+    }
+    if (duration <= 0 || depth <= 0 || depth > MAX_DEPTH || nr_devices > MAX_DEVICES) {
+        printf("Error: seconds must be positive, depth 1..%d and at most %d devices\n", MAX_DEPTH, MAX_DEVICES);
+        return 1;
+    }
+
+    double thread_rate = run_threads(argv + 4, nr_devices, duration);
+    if (thread_rate < 0) {
+        return 1;
+    }
+    double async_rate = run_async(argv + 4, nr_devices, depth, duration);
+    if (async_rate < 0) {
+        return 1;
+    }
+
+    printf("devices  threads transfers/sec  io_uring transfers/sec  speedup\n");
+    printf("%7d  %21.0f  %22.0f  %6.2fx\n", nr_devices, thread_rate, async_rate, async_rate / thread_rate);
+    return 0;
+}
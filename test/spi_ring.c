@@ -0,0 +1,115 @@
+#include "spi_ring.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+//---------------------------------------------------------------------------
+// Open/Close Functions
+//---------------------------------------------------------------------------
+
+/// @brief Set up the shared ring of an open simulator file and map it
+/// @param spidev_fd Simulator device file
+/// @param entries Ring size, a power of two
+/// @param slot_size Bytes per data slot, a power of two
+/// @return If the operation is successful, return 0. Otherwise, return -1
+int spi_ring_init(spi_ring_t *self, int spidev_fd, unsigned entries, unsigned slot_size) {
+    struct spi_sim_ring_setup setup = {.entries = entries, .slot_size = slot_size};
+
+    memset(self, 0, sizeof(*self));
+    self->spidev_fd = spidev_fd;
+
+    if (ioctl(spidev_fd, SPI_SIM_IOC_RING_SETUP, &setup) < 0) {
+        printf("    Error! Can't set up the ring: %s (fn: %s)\n", strerror(errno), __func__);
+        return -1;
+    }
+
+    self->mem = mmap(NULL, setup.mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, spidev_fd, 0);
+    if (self->mem == MAP_FAILED) {
+        printf("    Error! Can't map the ring: %s (fn: %s)\n", strerror(errno), __func__);
+        self->mem = NULL;
+        return -1;
+    }
+
+    self->size      = setup.mmap_size;
+    self->hdr       = self->mem;
+    self->sqes      = (struct spi_sim_ring_sqe *) ((uint8_t *) self->mem + self->hdr->sqe_off);
+    self->cqes      = (struct spi_sim_ring_cqe *) ((uint8_t *) self->mem + self->hdr->cqe_off);
+    self->data      = (uint8_t *) self->mem + self->hdr->data_off;
+    self->entries   = self->hdr->entries;
+    self->slot_size = self->hdr->slot_size;
+    return 0;
+}
+
+/// @brief Unmap the ring, it is freed when the device file is closed
+void spi_ring_deinit(spi_ring_t *self) {
+    if (self->mem) {
+        munmap(self->mem, self->size);
+        self->mem = NULL;
+    }
+}
+
+//---------------------------------------------------------------------------
+// Submission/Completion Functions
+//---------------------------------------------------------------------------
+
+/// @brief Data slot to write the request into, it holds the response after completion
+/// @param slot Slot index, below the ring size
+/// @return Pointer to the slot
+uint8_t *spi_ring_slot(spi_ring_t *self, unsigned slot) {
+    return self->data + (size_t) slot * self->slot_size;
+}
+
+/// @brief Queue a full-duplex transfer of a slot, it is not visible to the driver before spi_ring_enter
+/// @param slot Slot holding the request
+/// @param length Transfer length, at most the slot size
+/// @param user_data Value returned with the completion
+/// @return If the operation is successful, return 0. If the ring is full, return -1
+int spi_ring_queue(spi_ring_t *self, unsigned slot, uint32_t length, uint64_t user_data) {
+    unsigned head = __atomic_load_n(&self->hdr->sq_head, __ATOMIC_ACQUIRE);
+
+    if (self->sq_tail - head >= self->entries) {
+        return -1;
+    }
+
+    struct spi_sim_ring_sqe *sqe = &self->sqes[self->sq_tail & (self->entries - 1)];
+    sqe->user_data               = user_data;
+    sqe->slot                    = slot;
+    sqe->len                     = length;
+    self->sq_tail++;
+    return 0;
+}
+
+/// @brief Publish the queued transfers and ring the doorbell. In timing mode their completions
+///        are published once they have left the bus, poll() for POLLIN waits for them.
+/// @return The number of transfers the driver ran, or -1 on error
+int spi_ring_enter(spi_ring_t *self) {
+    __atomic_store_n(&self->hdr->sq_tail, self->sq_tail, __ATOMIC_RELEASE);
+
+    int ret = ioctl(self->spidev_fd, SPI_SIM_IOC_RING_ENTER);
+    if (ret < 0) {
+        printf("    Error! Ring doorbell failed: %s (fn: %s)\n", strerror(errno), __func__);
+        return -1;
+    }
+    return ret;
+}
+
+/// @brief Collect completions without a system call
+/// @param completions Array receiving the completions
+/// @param max Size of the array
+/// @return The number of completions stored
+int spi_ring_reap(spi_ring_t *self, struct spi_sim_ring_cqe *completions, int max) {
+    unsigned tail = __atomic_load_n(&self->hdr->cq_tail, __ATOMIC_ACQUIRE);
+    int      n    = 0;
+
+    while (self->cq_head != tail && n < max) {
+        completions[n++] = self->cqes[self->cq_head & (self->entries - 1)];
+        self->cq_head++;
+    }
+
+    __atomic_store_n(&self->hdr->cq_head, self->cq_head, __ATOMIC_RELEASE);
+    return n;
+}
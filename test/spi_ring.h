@@ -0,0 +1,38 @@
+#ifndef SPI_RING_H
+#define SPI_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "spi_simulator_ioctl.h"
+
+
+// Client side of the shared ring of one simulator file
+typedef struct {
+    int                      spidev_fd;
+    void                    *mem;
+    size_t                   size;
+    struct spi_sim_ring_hdr *hdr;
+    struct spi_sim_ring_sqe *sqes;
+    struct spi_sim_ring_cqe *cqes;
+    uint8_t                 *data;
+    unsigned                 entries;
+    unsigned                 slot_size;
+    unsigned                 sq_tail; // Local copies of the indexes the client owns
+    unsigned                 cq_head;
+} spi_ring_t;
+
+//---------------------------------------------------------------------------
+// Open/Close Functions
+//---------------------------------------------------------------------------
+int  spi_ring_init(spi_ring_t *self, int spidev_fd, unsigned entries, unsigned slot_size);
+void spi_ring_deinit(spi_ring_t *self);
+
+//---------------------------------------------------------------------------
+// Submission/Completion Functions
+//---------------------------------------------------------------------------
+uint8_t *spi_ring_slot(spi_ring_t *self, unsigned slot);
+int      spi_ring_queue(spi_ring_t *self, unsigned slot, uint32_t length, uint64_t user_data);
+int      spi_ring_enter(spi_ring_t *self);
+int      spi_ring_reap(spi_ring_t *self, struct spi_sim_ring_cqe *completions, int max);
+
+#endif //SPI_RING_H
@@ -0,0 +1,156 @@
+#include "spi_ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/spi/spidev.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CMD_SIZE 256
+#define SLOT_SIZE    256
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <device> <command> [seconds] [batch]\n", program_name);
+    printf("Example: %s /dev/spidev0.0 \"9F 00 00 00\" 2 256\n", program_name);
+    printf("  Compares full-duplex transfers/sec of SPI_IOC_MESSAGE(1) with the shared ring,\n");
+    printf("  which runs <batch> transfers per doorbell.\n");
+}
+
+static int parse_command(const char *str, uint8_t *out) {
+    int len = 0;
+
+    while (*str) {
+        char *end;
+        long  val = strtol(str, &end, 16);
+        if (end == str)
+            break;
+        if (len >= MAX_CMD_SIZE || val < 0 || val > 0xFF)
+            return -1;
+        out[len++] = (uint8_t) val;
+        str        = end;
+    }
+    return len;
+}
+
+static double run_ioctl(int fd, const uint8_t *command, int command_len, double duration) {
+    uint8_t                 rx_buffer[MAX_CMD_SIZE];
+    struct spi_ioc_transfer tr        = {.tx_buf = (unsigned long) command, .rx_buf = (unsigned long) rx_buffer,
+                                         .len    = command_len};
+    uint64_t                transfers = 0;
+    double                  start     = now_seconds();
+    double                  elapsed;
+
+    do {
+        for (int i = 0; i < 256; i++) {
+            if (ioctl(fd, SPI_IOC_MESSAGE(1), &tr) < 0) {
+                printf("Error: SPI transfer failed: %s\n", strerror(errno));
+                return -1;
+            }
+        }
+        transfers += 256;
+        elapsed = now_seconds() - start;
+    } while (elapsed < duration);
+
+    return transfers / elapsed;
+}
+
+static double run_ring(int fd, const uint8_t *command, int command_len, unsigned batch, double duration) {
+    static struct spi_sim_ring_cqe completions[SPI_SIM_RING_MAX_ENTRIES];
+    spi_ring_t                     ring;
+    uint64_t                       transfers = 0;
+    double                         start;
+    double                         elapsed;
+
+    if (spi_ring_init(&ring, fd, batch, SLOT_SIZE) < 0) {
+        return -1;
+    }
+
+    start = now_seconds();
+    do {
+        // The response replaced the request, write it again before queuing the slot
+        for (unsigned slot = 0; slot < batch; slot++) {
+            memcpy(spi_ring_slot(&ring, slot), command, command_len);
+            spi_ring_queue(&ring, slot, command_len, slot);
+        }
+        int ran = spi_ring_enter(&ring);
+        if (ran < 0) {
+            spi_ring_deinit(&ring);
+            return -1;
+        }
+
+        // In timing mode the completions arrive once the batch has left the bus
+        for (int reaped = 0; reaped < ran;) {
+            int n = spi_ring_reap(&ring, completions, batch);
+            if (!n) {
+                struct pollfd pfd = {.fd = fd, .events = POLLIN};
+                if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                    printf("Error: poll failed: %s\n", strerror(errno));
+                    spi_ring_deinit(&ring);
+                    return -1;
+                }
+                continue;
+            }
+            for (int i = 0; i < n; i++) {
+                if (completions[i].res < 0) {
+                    printf("Error: SPI transfer failed: %s\n", strerror(-completions[i].res));
+                    spi_ring_deinit(&ring);
+                    return -1;
+                }
+            }
+            reaped += n;
+        }
+        transfers += ran;
+        elapsed = now_seconds() - start;
+    } while (elapsed < duration);
+
+    spi_ring_deinit(&ring);
+    return transfers / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    uint8_t  command[MAX_CMD_SIZE];
+    int      command_len = parse_command(argv[2], command);
+    double   duration    = argc > 3 ? atof(argv[3]) : 2.0;
+    unsigned batch       = argc > 4 ? atoi(argv[4]) : 256;
+
+    if (command_len <= 0 || command_len > SLOT_SIZE) {
+        printf("Error: Invalid command, use space separated hex bytes\n");
+        return 1;
+    }
+    if (duration <= 0 || batch == 0 || batch > SPI_SIM_RING_MAX_ENTRIES || (batch & (batch - 1))) {
+        printf("Error: seconds must be positive and batch a power of two up to %d\n", SPI_SIM_RING_MAX_ENTRIES);
+        return 1;
+    }
+
+    int fd = open(argv[1], O_RDWR);
+    if (fd < 0) {
+        printf("Error: Cannot open device %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    double ioctl_rate = run_ioctl(fd, command, command_len, duration);
+    double ring_rate  = ioctl_rate < 0 ? -1 : run_ring(fd, command, command_len, batch, duration);
+    close(fd);
+    if (ring_rate < 0) {
+        return 1;
+    }
+
+    printf("ioctl transfers/sec  ring transfers/sec  speedup\n");
+    printf("%19.0f  %18.0f  %6.2fx\n", ioctl_rate, ring_rate, ring_rate / ioctl_rate);
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "spi_seq_core.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REQ_LEN     4
+#define BATCH       1024
+#define MAX_ENTRIES (1 << 24) // Keys stay below PATTERN_HI
+#define MISS_BYTE   0xFF // No generated key starts with it
+#define PATTERN_HI  0xC0 // Pattern keys start with a byte of 0xC?
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s [seconds] [max entries]\n", program_name);
+    printf("Example: %s 1 1048576\n", program_name);
+    printf("  Compiles generated sequence tables of growing size and pattern count with the\n");
+    printf("  sequence core library, compares JSON compile time with loading the precompiled\n");
+    printf("  image and reports lookups/sec for hits and misses. Needs no device.\n");
+}
+
+// Unique key of entry i, the low three bytes are scrambled like real command arguments
+static void entry_key(uint32_t i, uint8_t *key) {
+    uint32_t k = i * 2654435761u;
+
+    key[0] = i >> 24;
+    key[1] = k >> 16;
+    key[2] = k >> 8;
+    key[3] = k;
+}
+
+// nr_entries exact sequences, nr_patterns of them "C? ?? XX YY" patterns
+static char *make_sequences(uint32_t nr_entries, uint32_t nr_patterns, size_t *len) {
+    size_t size = (size_t) nr_entries * 96 + 16;
+    char  *buf  = malloc(size);
+    size_t off  = 0;
+
+    if (!buf)
+        return NULL;
+
+    off += sprintf(buf + off, "[\n");
+    for (uint32_t i = 0; i < nr_entries; i++) {
+        uint8_t key[REQ_LEN];
+
+        entry_key(i, key);
+        if (i < nr_patterns)
+            off += sprintf(buf + off,
+                           "{\"received\": \"%X? ?? %02X %02X\", \"match\": \"exact\", \"response\": \"00 $2\"}",
+                           PATTERN_HI >> 4, i >> 8 & 0xFF, i & 0xFF);
+        else
+            off += sprintf(buf + off,
+                           "{\"received\": \"%02X %02X %02X %02X\", \"match\": \"exact\", \"response\": \"00 AA\"}",
+                           key[0], key[1], key[2], key[3]);
+        off += sprintf(buf + off, i + 1 < nr_entries ? ",\n" : "\n");
+    }
+    off += sprintf(buf + off, "]\n");
+    *len = off;
+    return buf;
+}
+
+// Lookups/sec over requests, errors counts requests whose match is not the expected one
+static double run_lookups(const struct spi_seq_table *table, const uint8_t (*reqs)[REQ_LEN], int hit,
+                          double duration, uint64_t *errors) {
+    uint8_t  out[REQ_LEN];
+    uint64_t lookups = 0;
+    double   start   = now_seconds();
+    double   elapsed;
+
+    do {
+        for (int i = 0; i < BATCH; i++) {
+            const struct spi_seq_entry *seq = spi_seq_lookup(table, reqs[i], REQ_LEN);
+
+            if (!seq != !hit) {
+                (*errors)++;
+            } else if (seq) {
+                const struct spi_seq_resp *resp = spi_seq_respond(table, seq);
+
+                spi_seq_copy(table, resp, reqs[i], REQ_LEN, out, 0, resp->len);
+                spi_seq_finish(table, seq);
+            }
+        }
+        lookups += BATCH;
+        elapsed = now_seconds() - start;
+    } while (elapsed < duration);
+
+    return lookups / elapsed;
+}
+
+static int run_case(uint32_t nr_entries, uint32_t nr_patterns, double duration) {
+    static uint8_t        hits[BATCH][REQ_LEN];
+    static uint8_t        misses[BATCH][REQ_LEN];
+    struct spi_seq_table *table;
+    struct spi_seq_table *loaded;
+    uint64_t              errors = 0;
+    void                 *image;
+    size_t                image_len;
+    size_t                len;
+    double                start;
+    double                compile_ms;
+    double                load_ms;
+    LIST_HEAD(sequences);
+
+    char *buf = make_sequences(nr_entries, nr_patterns, &len);
+    if (!buf) {
+        printf("Error: Out of memory\n");
+        return -1;
+    }
+
+    start = now_seconds();
+    table = spi_seq_parse(buf, len, &sequences) ? NULL : spi_seq_compile(&sequences);
+    spi_seq_parse_free(&sequences);
+    compile_ms = (now_seconds() - start) * 1e3;
+    free(buf);
+    if (!table || table->nr_entries != nr_entries) {
+        printf("Error: Sequence table of %u entries did not compile\n", nr_entries);
+        spi_seq_free(table);
+        return -1;
+    }
+
+    // The lookups run on the table adopted from its image, so the image round trip is checked too
+    int ret = spi_seq_save_image(table, &image, &image_len);
+    spi_seq_free(table);
+    if (ret) {
+        printf("Error: Image of %u entries not written: %s\n", nr_entries, strerror(-ret));
+        return -1;
+    }
+    start   = now_seconds();
+    ret     = spi_seq_load_image(image, image_len, &loaded);
+    load_ms = (now_seconds() - start) * 1e3;
+    free(image);
+    if (ret) {
+        printf("Error: Image of %u entries not loaded: %s\n", nr_entries, strerror(-ret));
+        return -1;
+    }
+    table = loaded;
+
+    // Hits alternate between keys and patterns in proportion, misses share no first byte
+    srand(nr_entries ^ nr_patterns);
+    for (int i = 0; i < BATCH; i++) {
+        uint32_t idx = (uint32_t) rand() % nr_entries;
+
+        entry_key(idx, hits[i]);
+        if (idx < nr_patterns) {
+            hits[i][0] = PATTERN_HI | (rand() & 0xF);
+            hits[i][1] = rand();
+            hits[i][2] = idx >> 8;
+            hits[i][3] = idx;
+        }
+        memcpy(misses[i], hits[i], REQ_LEN);
+        misses[i][0] = MISS_BYTE;
+    }
+
+    double hit_rate  = run_lookups(table, (const uint8_t(*)[REQ_LEN]) hits, 1, duration, &errors);
+    double miss_rate = run_lookups(table, (const uint8_t(*)[REQ_LEN]) misses, 0, duration, &errors);
+    spi_seq_free(table);
+
+    printf("%10u  %8u  %10.1f  %8.1f  %9.1f  %13.0f  %14.0f\n", nr_entries, nr_patterns, compile_ms, load_ms,
+           image_len / 1048576.0, hit_rate, miss_rate);
+    if (errors) {
+        printf("Error: %llu lookups returned the wrong result\n", (unsigned long long) errors);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    static const uint32_t patterns[] = {0, 16, 256, SPI_SEQ_MAX_PATTERNS};
+    double                duration   = argc > 1 ? atof(argv[1]) : 0.5;
+    uint32_t              max        = argc > 2 ? strtoul(argv[2], NULL, 0) : 1 << 20;
+
+    if (argc > 3 || duration <= 0 || max < SPI_SEQ_MAX_PATTERNS || max > MAX_ENTRIES) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    printf("   entries  patterns  compile ms  image ms  image MiB  hit lookups/s  miss lookups/s\n");
+    for (uint32_t nr_entries = SPI_SEQ_MAX_PATTERNS; nr_entries <= max; nr_entries *= 32) {
+        for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+            if (run_case(nr_entries, patterns[p], duration))
+                return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,304 @@
+#include "spi_seq_core.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Regression test of the sequence core: matching, responses, states and the image checks.
+// Every step is one transfer, run the way the driver runs a write.
+struct seq_step {
+    const char *req; // Hex bytes
+    int         entry; // Index of the matching entry, -1 for no match
+    uint32_t    src; // Position of the matching sequence in the file
+    const char *resp; // Hex bytes of the response
+    uint32_t    state; // State after chip select went high
+};
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                                               \
+    do {                                                                                                               \
+        if (!(cond)) {                                                                                                 \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+            failures++;                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+static uint32_t parse_hex(const char *str, uint8_t *out) {
+    uint32_t len = 0;
+    char    *end;
+
+    for (;;) {
+        unsigned long value = strtoul(str, &end, 16);
+        if (end == str)
+            return len;
+        out[len++] = value;
+        str        = end;
+    }
+}
+
+static struct spi_seq_table *compile(const char *json) {
+    struct spi_seq_table *table;
+    LIST_HEAD(sequences);
+
+    table = spi_seq_parse(json, strlen(json), &sequences) ? NULL : spi_seq_compile(&sequences);
+    spi_seq_parse_free(&sequences);
+    return table;
+}
+
+static uint32_t current_state(const struct spi_seq_table *table) {
+    return (uint32_t) atomic_read(table->state) & SPI_SEQ_STATE_MASK;
+}
+
+static void run_steps(const char *name, const struct spi_seq_table *table, const struct seq_step *steps,
+                      size_t nr_steps) {
+    for (size_t i = 0; i < nr_steps; i++) {
+        const struct seq_step      *step = &steps[i];
+        const struct spi_seq_entry *seq;
+        uint8_t                     req[64];
+        uint8_t                     want[64];
+        uint8_t                     out[64];
+        uint32_t                    req_len  = parse_hex(step->req, req);
+        uint32_t                    want_len = step->resp ? parse_hex(step->resp, want) : 0;
+
+        seq = spi_seq_lookup(table, req, req_len);
+        if (step->entry < 0) {
+            CHECK(!seq, "%s step %zu [%s]: matched entry %td, expected none", name, i, step->req,
+                  seq - table->entries);
+            continue;
+        }
+        if (!seq) {
+            CHECK(seq, "%s step %zu [%s]: no match, expected entry %d", name, i, step->req, step->entry);
+            continue;
+        }
+        CHECK(seq - table->entries == step->entry, "%s step %zu [%s]: matched entry %td, expected %d", name, i,
+              step->req, seq - table->entries, step->entry);
+        CHECK(seq->src == step->src, "%s step %zu [%s]: source position %u, expected %u", name, i, step->req,
+              seq->src, step->src);
+
+        const struct spi_seq_resp *resp = spi_seq_respond(table, seq);
+        CHECK(resp->len == want_len, "%s step %zu [%s]: response of %u bytes, expected %u", name, i, step->req,
+              resp->len, want_len);
+        if (resp->len == want_len && want_len <= sizeof(out)) {
+            spi_seq_copy(table, resp, req, req_len, out, 0, resp->len);
+            CHECK(!memcmp(out, want, want_len), "%s step %zu [%s]: response differs from [%s]", name, i, step->req,
+                  step->resp);
+        }
+        spi_seq_finish(table, seq);
+        CHECK(current_state(table) == step->state, "%s step %zu [%s]: state %u, expected %u", name, i, step->req,
+              current_state(table), step->state);
+    }
+}
+
+#define RUN_STEPS(name, table, steps) run_steps(name, table, steps, sizeof(steps) / sizeof(steps[0]))
+
+// Exact and prefix rules, wildcard lengths and the longest key. The duplicate at position 1 is
+// skipped, so entry indexes and file positions differ from there on.
+static const char exact_json[] = "["
+                                 "{\"received\": \"05\", \"match\": \"exact\", \"response\": \"01\"},"
+                                 "{\"received\": \"05\", \"match\": \"exact\", \"response\": \"09\"},"
+                                 "{\"received\": \"05\", \"response\": \"02\"},"
+                                 "{\"received\": \"03\", \"length\": 4, \"response\": \"11 22\"},"
+                                 "{\"received\": \"03 01\", \"response\": \"33\"},"
+                                 "{\"received\": \"04\", \"length\": 2, \"match\": \"exact\", \"response\": \"44\"}"
+                                 "]";
+
+static const struct seq_step exact_steps[] = {
+    {"05", 0, 0, "01", 0},
+    {"05 00", 1, 2, "02", 0},
+    {"05 00 00 00", 1, 2, "02", 0},
+    {"03 00 00", -1},
+    {"03 00 00 00", 2, 3, "11 22", 0},
+    {"03 00 00 00 00", 2, 3, "11 22", 0},
+    {"03 01 00 00", 3, 4, "33", 0},
+    {"03 01", 3, 4, "33", 0},
+    {"04", -1},
+    {"04 AA", 4, 5, "44", 0},
+    {"04 AA BB", -1},
+    {"9F", -1},
+};
+
+// Nibble, masked and wildcard patterns, echoed request bytes. A plain key wins over a pattern of
+// the same length, references past the request read as zero.
+static const char pattern_json[] = "["
+                                   "{\"received\": \"03 ?? ?? ??\", \"response\": \"00 00 00 00 $1 $2 $3\"},"
+                                   "{\"received\": \"80/80\", \"response\": \"00 $0\"},"
+                                   "{\"received\": \"1?\", \"response\": \"AA\"},"
+                                   "{\"received\": \"12\", \"response\": \"BB\"},"
+                                   "{\"received\": \"44\", \"response\": \"$0 $5\"},"
+                                   "{\"received\": \"0B ??\", \"match\": \"exact\", \"response\": \"$1 $1\"}"
+                                   "]";
+
+static const struct seq_step pattern_steps[] = {
+    {"03 0A 0B 0C", 0, 0, "00 00 00 00 0A 0B 0C", 0},
+    {"03 0A 0B", -1},
+    {"81", 1, 1, "00 81", 0},
+    {"FF 01", 1, 1, "00 FF", 0},
+    {"7F", -1},
+    {"15", 2, 2, "AA", 0},
+    {"12", 3, 3, "BB", 0},
+    {"44", 4, 4, "44 00", 0},
+    {"0B 5A", 5, 5, "5A 5A", 0},
+    {"0B 5A 00", -1},
+};
+
+// The flash of the README: write enable, then an erase that reports busy three times. Entering
+// the erasing state again starts the responses over.
+static const char state_json[] =
+    "["
+    "{\"received\": \"06\", \"next\": \"wel\"},"
+    "{\"received\": \"05\", \"response\": \"00\"},"
+    "{\"received\": \"05\", \"state\": \"wel\", \"response\": \"02\"},"
+    "{\"received\": \"20\", \"length\": 4, \"state\": \"wel\", \"next\": \"erasing\"},"
+    "{\"received\": \"05\", \"state\": \"erasing\", \"responses\": [{\"response\": \"03\", \"repeat\": 3}, "
+    "{\"response\": \"00\", \"next\": \"\"}]}"
+    "]";
+
+#define STATE_WEL     1
+#define STATE_ERASING 2
+
+static const struct seq_step state_steps[] = {
+    {"05", 1, 1, "00", 0},
+    {"20 00 00 00", -1},
+    {"06", 0, 0, NULL, STATE_WEL},
+    {"05", 2, 2, "02", STATE_WEL},
+    {"20 00 10 00", 3, 3, NULL, STATE_ERASING},
+    {"05", 4, 4, "03", STATE_ERASING},
+    {"05", 4, 4, "03", STATE_ERASING},
+    {"05", 4, 4, "03", STATE_ERASING},
+    {"05", 4, 4, "00", 0},
+    {"05", 1, 1, "00", 0},
+    {"06", 0, 0, NULL, STATE_WEL},
+    {"20 00 20 00", 3, 3, NULL, STATE_ERASING},
+    {"05", 4, 4, "03", STATE_ERASING},
+};
+
+static void test_table(const char *name, const char *json, const struct seq_step *steps, size_t nr_steps) {
+    struct spi_seq_table *table = compile(json);
+
+    CHECK(table, "%s: table did not compile", name);
+    if (!table)
+        return;
+    run_steps(name, table, steps, nr_steps);
+    spi_seq_free(table);
+}
+
+// Section offsets of an image, in the order spi_seq_save_image writes them
+struct image_layout {
+    size_t entries;
+    size_t buckets;
+    size_t key_lens;
+    size_t patterns;
+};
+
+static struct image_layout image_layout(const struct spi_seq_image *hdr) {
+    struct image_layout layout;
+
+    layout.entries  = sizeof(*hdr);
+    layout.buckets  = layout.entries + (size_t) hdr->nr_entries * sizeof(struct spi_seq_entry);
+    layout.key_lens = layout.buckets + (size_t) hdr->nr_buckets * sizeof(uint32_t);
+    layout.patterns = layout.key_lens + (size_t) hdr->nr_key_lens * sizeof(uint32_t);
+    return layout;
+}
+
+static void expect_rejected(const char *what, const void *image, size_t len) {
+    struct spi_seq_table *table = NULL;
+    int                   ret   = spi_seq_load_image(image, len, &table);
+
+    CHECK(ret == -EINVAL, "image with %s: load returned %d, expected %d", what, ret, -EINVAL);
+    if (!ret)
+        spi_seq_free(table);
+}
+
+// A loaded image answers like the compiled table, every corruption below is refused
+static void test_image(void) {
+    struct spi_seq_table *table = compile(state_json);
+    struct spi_seq_table *loaded;
+    struct spi_seq_image *hdr;
+    struct image_layout   layout;
+    uint8_t              *image;
+    uint8_t              *bad;
+    size_t                len;
+    uint32_t              word;
+    int                   ret;
+
+    CHECK(table && !spi_seq_save_image(table, (void **) &image, &len), "state table: image not written");
+    spi_seq_free(table);
+    if (!table)
+        return;
+    ret = spi_seq_load_image(image, len, &loaded);
+    CHECK(!ret, "state table: own image not loaded");
+    if (!ret) {
+        RUN_STEPS("state image", loaded, state_steps);
+        spi_seq_free(loaded);
+    }
+    free(image);
+
+    table = compile(pattern_json);
+    CHECK(table && !spi_seq_save_image(table, (void **) &image, &len), "pattern table: image not written");
+    spi_seq_free(table);
+    if (!table)
+        return;
+    ret = spi_seq_load_image(image, len, &loaded);
+    CHECK(!ret, "pattern table: own image not loaded");
+    if (!ret) {
+        RUN_STEPS("pattern image", loaded, pattern_steps);
+        spi_seq_free(loaded);
+    }
+
+    hdr    = (struct spi_seq_image *) image;
+    layout = image_layout(hdr);
+    bad    = malloc(len);
+
+    expect_rejected("a truncated section", image, len - sizeof(uint32_t));
+
+    memcpy(bad, image, len);
+    ((struct spi_seq_image *) bad)->magic ^= 1;
+    expect_rejected("a wrong magic", bad, len);
+
+    memcpy(bad, image, len);
+    ((struct spi_seq_image *) bad)->version++;
+    expect_rejected("a newer version", bad, len);
+
+    // A bucket leading to a pattern, patterns are in no hash chain
+    memcpy(bad, image, len);
+    memcpy(&word, bad + layout.patterns, sizeof(word));
+    memcpy(bad + layout.buckets, &word, sizeof(word));
+    expect_rejected("a bucket pointing at a pattern", bad, len);
+
+    // A chain link running backwards could loop, entries 3 and 4 are the plain keys "12" and "44"
+    memcpy(bad, image, len);
+    word = 3;
+    memcpy(bad + layout.entries + 4 * sizeof(struct spi_seq_entry) + offsetof(struct spi_seq_entry, next), &word,
+           sizeof(word));
+    expect_rejected("a chain link running backwards", bad, len);
+
+    // Lookups would hash request bytes past max_req_len
+    memcpy(bad, image, len);
+    word = 64;
+    memcpy(bad + layout.key_lens + (hdr->nr_key_lens - 1) * sizeof(uint32_t), &word, sizeof(word));
+    expect_rejected("a key length past the longest request", bad, len);
+
+    memcpy(bad, image, len);
+    ((struct spi_seq_image *) bad)->pattern_len = SPI_SEQ_MAX_PATTERN_LEN;
+    expect_rejected("a pattern length past the longest request", bad, len);
+
+    free(bad);
+    free(image);
+}
+
+int main(void) {
+    test_table("exact", exact_json, exact_steps, sizeof(exact_steps) / sizeof(exact_steps[0]));
+    test_table("pattern", pattern_json, pattern_steps, sizeof(pattern_steps) / sizeof(pattern_steps[0]));
+    test_table("state", state_json, state_steps, sizeof(state_steps) / sizeof(state_steps[0]));
+    test_image();
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All sequence core checks passed\n");
+    return 0;
+}
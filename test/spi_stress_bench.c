@@ -0,0 +1,153 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/spi/spidev.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS  64
+#define MAX_CMD_SIZE 256
+
+typedef struct {
+    const char *device_path;
+    uint8_t     command[MAX_CMD_SIZE];
+    int         command_len;
+    double      duration;
+    uint64_t    transfers;
+    int         error;
+} worker_t;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <device> <command> [seconds] [max_threads]\n", program_name);
+    printf("Example: %s /dev/spidev0.0 \"9F 01\" 2 16\n", program_name);
+    printf("  Runs full-duplex transfers of <command> from 1, 2, 4 ... max_threads threads\n");
+    printf("  and prints the total transfers/sec for each thread count.\n");
+}
+
+static int parse_command(const char *str, uint8_t *out) {
+    int len = 0;
+
+    while (*str) {
+        char *end;
+        long  val = strtol(str, &end, 16);
+        if (end == str)
+            break;
+        if (len >= MAX_CMD_SIZE || val < 0 || val > 0xFF)
+            return -1;
+        out[len++] = (uint8_t) val;
+        str        = end;
+    }
+    return len;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *self = arg;
+    uint8_t   rx_buffer[MAX_CMD_SIZE];
+
+    // Each thread opens its own file, like independent test processes would
+    int fd = open(self->device_path, O_RDWR);
+    if (fd < 0) {
+        printf("Error: Cannot open device %s: %s\n", self->device_path, strerror(errno));
+        self->error = 1;
+        return NULL;
+    }
+
+    struct spi_ioc_transfer tr = {
+            .tx_buf        = (unsigned long) self->command,
+            .rx_buf        = (unsigned long) rx_buffer,
+            .len           = self->command_len,
+            .speed_hz      = 500000,
+            .bits_per_word = 8,
+    };
+
+    double end_time = now_seconds() + self->duration;
+    while (now_seconds() < end_time) {
+        // Check the clock every 256 transfers to keep the loop tight
+        for (int i = 0; i < 256; i++) {
+            if (ioctl(fd, SPI_IOC_MESSAGE(1), &tr) < 0) {
+                printf("Error: SPI transfer failed: %s\n", strerror(errno));
+                self->error = 1;
+                close(fd);
+                return NULL;
+            }
+        }
+        self->transfers += 256;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *device_path = argv[1];
+    double      duration    = argc > 3 ? atof(argv[3]) : 2.0;
+    int         max_threads = argc > 4 ? atoi(argv[4]) : 8;
+    uint8_t     command[MAX_CMD_SIZE];
+    int         command_len = parse_command(argv[2], command);
+
+    if (command_len <= 0) {
+        printf("Error: Invalid command, use space separated hex bytes\n");
+        return 1;
+    }
+    if (duration <= 0 || max_threads <= 0 || max_threads > MAX_THREADS) {
+        printf("Error: seconds must be positive and max_threads between 1 and %d\n", MAX_THREADS);
+        return 1;
+    }
+
+    static worker_t  workers[MAX_THREADS];
+    static pthread_t threads[MAX_THREADS];
+    double           single_rate = 0;
+
+    printf("threads  transfers/sec  speedup\n");
+    for (int nr_threads = 1; nr_threads <= max_threads; nr_threads *= 2) {
+        for (int i = 0; i < nr_threads; i++) {
+            memset(&workers[i], 0, sizeof(workers[i]));
+            workers[i].device_path = device_path;
+            workers[i].duration    = duration;
+            workers[i].command_len = command_len;
+            memcpy(workers[i].command, command, command_len);
+        }
+
+        double start = now_seconds();
+        for (int i = 0; i < nr_threads; i++) {
+            pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+        }
+
+        uint64_t total = 0;
+        int      error = 0;
+        for (int i = 0; i < nr_threads; i++) {
+            pthread_join(threads[i], NULL);
+            total += workers[i].transfers;
+            error |= workers[i].error;
+        }
+        double elapsed = now_seconds() - start;
+
+        if (error) {
+            return 1;
+        }
+
+        double rate = total / elapsed;
+        if (nr_threads == 1) {
+            single_rate = rate;
+        }
+        printf("%7d  %13.0f  %6.2fx\n", nr_threads, rate, single_rate > 0 ? rate / single_rate : 0);
+    }
+
+    return 0;
+}
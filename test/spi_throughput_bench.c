@@ -0,0 +1,97 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/spi/spidev.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MIN_SIZE (1 << 10)
+#define MAX_SIZE (1 << 16)
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <device> [seconds_per_size]\n", program_name);
+    printf("Example: %s /dev/spidev0.0 1\n", program_name);
+    printf("  Measures MB/s of write, read and full-duplex transfers from %d B to %d KiB.\n", MIN_SIZE,
+           MAX_SIZE >> 10);
+}
+
+// Run transfers of one kind for the given time and return MB/s
+static double run(int fd, struct spi_ioc_transfer *tr, double duration) {
+    uint64_t transfers = 0;
+    double   start     = now_seconds();
+    double   elapsed;
+
+    do {
+        for (int i = 0; i < 16; i++) {
+            if (ioctl(fd, SPI_IOC_MESSAGE(1), tr) < 0) {
+                printf("Error: SPI transfer failed: %s\n", strerror(errno));
+                return -1;
+            }
+        }
+        transfers += 16;
+        elapsed = now_seconds() - start;
+    } while (elapsed < duration);
+
+    return transfers * (double) tr->len / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *device_path = argv[1];
+    double      duration    = argc > 2 ? atof(argv[2]) : 1.0;
+
+    int fd = open(device_path, O_RDWR);
+    if (fd < 0) {
+        printf("Error: Cannot open device %s: %s\n", device_path, strerror(errno));
+        return 1;
+    }
+
+    uint8_t *tx_buffer = malloc(MAX_SIZE);
+    uint8_t *rx_buffer = malloc(MAX_SIZE);
+    if (!tx_buffer || !rx_buffer) {
+        printf("Error: Memory allocation failed\n");
+        free(tx_buffer);
+        free(rx_buffer);
+        close(fd);
+        return 1;
+    }
+
+    // Test pattern, the content does not matter for the throughput
+    memset(tx_buffer, 0x5A, MAX_SIZE);
+
+    printf("    size   write MB/s    read MB/s  duplex MB/s\n");
+    for (uint32_t size = MIN_SIZE; size <= MAX_SIZE; size *= 2) {
+        struct spi_ioc_transfer write_tr  = {.tx_buf = (unsigned long) tx_buffer, .len = size};
+        struct spi_ioc_transfer read_tr   = {.rx_buf = (unsigned long) rx_buffer, .len = size};
+        struct spi_ioc_transfer duplex_tr = {
+                .tx_buf = (unsigned long) tx_buffer, .rx_buf = (unsigned long) rx_buffer, .len = size};
+
+        double write_rate  = run(fd, &write_tr, duration);
+        double read_rate   = run(fd, &read_tr, duration);
+        double duplex_rate = run(fd, &duplex_tr, duration);
+        if (write_rate < 0 || read_rate < 0 || duplex_rate < 0) {
+            break;
+        }
+
+        printf("%6u K  %11.1f  %11.1f  %11.1f\n", size >> 10, write_rate, read_rate, duplex_rate);
+    }
+
+    free(tx_buffer);
+    free(rx_buffer);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "spi_simulator_ioctl.h"
+
+#define BATCH 256
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int sig) {
+    (void) sig;
+    running = 0;
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <device name> [output file]\n", program_name);
+    printf("Example: %s spidev0.0 soak.bin\n", program_name);
+    printf("  Streams the transfer capture of the device until Ctrl-C. Records are printed,\n");
+    printf("  or written unchanged to the output file for later decoding.\n");
+}
+
+static void print_bytes(const char *name, const uint8_t *data, uint32_t len) {
+    printf(" %s=", name);
+    for (uint32_t i = 0; i < len && i < SPI_SIM_TRACE_DATA; i++)
+        printf("%02X", data[i]);
+    if (len > SPI_SIM_TRACE_DATA)
+        printf("..");
+}
+
+static void print_record(const struct spi_sim_trace_rec *rec) {
+    if (rec->flags & SPI_SIM_TRACE_LOST) {
+        printf("%llu.%09llu lost %u records\n", (unsigned long long) rec->ts_ns / 1000000000ULL,
+               (unsigned long long) rec->ts_ns % 1000000000ULL, rec->len);
+        return;
+    }
+
+    printf("%llu.%09llu len=%u speed=%u mode=%u", (unsigned long long) rec->ts_ns / 1000000000ULL,
+           (unsigned long long) rec->ts_ns % 1000000000ULL, rec->len, rec->speed_hz, rec->mode);
+    if (rec->seq_id != SPI_SIM_TRACE_NO_SEQ)
+        printf(" seq=%u", rec->seq_id);
+    else
+        printf(" seq=-");
+    if (rec->flags & SPI_SIM_TRACE_CONT)
+        printf(" cont");
+    if (rec->flags & SPI_SIM_TRACE_TX)
+        print_bytes("tx", rec->tx, rec->len);
+    if (rec->flags & SPI_SIM_TRACE_RX)
+        print_bytes("rx", rec->rx, rec->len);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    static struct spi_sim_trace_rec records[BATCH];
+    char                            path[256];
+    FILE                           *out      = NULL;
+    unsigned long long              captured = 0;
+    unsigned long long              lost     = 0;
+
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    snprintf(path, sizeof(path), "/sys/kernel/debug/spi_simulator/%s/trace", argv[1]);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (argc > 2) {
+        out = fopen(argv[2], "wb");
+        if (!out) {
+            printf("Error: Cannot create %s: %s\n", argv[2], strerror(errno));
+            close(fd);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    // Reads block until records arrive, a signal ends the capture
+    while (running) {
+        ssize_t n = read(fd, records, sizeof(records));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("Error: Read failed: %s\n", strerror(errno));
+            break;
+        }
+
+        int count = n / sizeof(records[0]);
+        for (int i = 0; i < count; i++) {
+            if (records[i].flags & SPI_SIM_TRACE_LOST)
+                lost += records[i].len;
+            else
+                captured++;
+            if (!out)
+                print_record(&records[i]);
+        }
+        if (out && fwrite(records, sizeof(records[0]), count, out) != (size_t) count) {
+            printf("Error: Write to %s failed\n", argv[2]);
+            break;
+        }
+    }
+
+    fprintf(stderr, "%llu transfers captured, %llu lost\n", captured, lost);
+    if (out)
+        fclose(out);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "linux_spi.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE_DATA_SIZE 16
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <device> [iterations]\n", program_name);
+    printf("Example: %s /dev/spidev0.0 100000\n", program_name);
+    printf("  Runs \"write enable, page program, read status\" with one ioctl per step and\n");
+    printf("  as a single transaction, then prints ioctls and latency per operation.\n");
+    printf("  Load the device with model=nor for a realistic flash.\n");
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static const uint8_t write_enable[]                   = {0x06};
+static const uint8_t read_status[]                    = {0x05};
+static uint8_t       page_program[4 + PAGE_DATA_SIZE] = {0x02, 0x00, 0x10, 0x00};
+
+// Three calls of the per-call API, one ioctl each
+static int operation_per_call(spi_config_t *spi, uint8_t *status) {
+    if (spi_write(spi, (uint8_t *) write_enable, sizeof(write_enable)) < 0 ||
+        spi_write(spi, page_program, sizeof(page_program)) < 0) {
+        return -1;
+    }
+    return spi_transfer(spi, read_status, sizeof(read_status), status, 1);
+}
+
+// The same frames queued into one SPI_IOC_MESSAGE(4)
+static int operation_transaction(spi_config_t *spi, uint8_t *status) {
+    spi_transaction_t transaction;
+
+    spi_transaction_begin(spi, &transaction);
+    spi_transaction_write(&transaction, write_enable, sizeof(write_enable));
+    spi_transaction_cs_change(&transaction);
+    spi_transaction_write(&transaction, page_program, sizeof(page_program));
+    spi_transaction_cs_change(&transaction);
+    spi_transaction_write(&transaction, read_status, sizeof(read_status));
+    spi_transaction_read(&transaction, status, 1);
+    return spi_transaction_submit(&transaction);
+}
+
+// Run one flavour, print latency percentiles in microseconds
+static int run(spi_config_t *spi, const char *name, int (*operation)(spi_config_t *, uint8_t *), int ioctls,
+               double *samples, int iterations) {
+    uint8_t status;
+    double  total = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        double start = now_seconds();
+        if (operation(spi, &status) < 0) {
+            printf("Error: SPI operation failed: %s\n", strerror(errno));
+            return -1;
+        }
+        samples[i] = (now_seconds() - start) * 1e6;
+        total += samples[i];
+    }
+
+    qsort(samples, iterations, sizeof(samples[0]), compare_double);
+    printf("%-12s %6d %10.2f %10.2f %10.2f\n", name, ioctls, total / iterations, samples[iterations / 2],
+           samples[(int) (iterations * 0.99)]);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+    if (iterations <= 0) {
+        printf("Error: iterations must be positive\n");
+        return 1;
+    }
+
+    spi_config_t spi = {
+            .device    = argv[1],
+            .mode      = SPI_MODE_0,
+            .bits      = 8,
+            .speed     = 500000,
+            .spidev_fd = -1,
+    };
+    if (spi_init(&spi) < 0) {
+        return 1;
+    }
+
+    double *samples = malloc(iterations * sizeof(double));
+    if (!samples) {
+        printf("Error: Memory allocation failed\n");
+        spi_deinit(&spi);
+        return 1;
+    }
+    memset(page_program + 4, 0x5A, PAGE_DATA_SIZE);
+
+    printf("\n%-12s %6s %10s %10s %10s\n", "api", "ioctls", "avg us", "p50 us", "p99 us");
+    int ret = run(&spi, "per-call", operation_per_call, 3, samples, iterations);
+    if (ret == 0) {
+        ret = run(&spi, "transaction", operation_transaction, 1, samples, iterations);
+    }
+
+    free(samples);
+    spi_deinit(&spi);
+    return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+#include "linux_spi.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_CMD_SIZE 256
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s <device> <command> [rx_length] [seconds]\n", program_name);
+    printf("Example: %s /dev/spidev0.0 \"9F\" 3 2\n", program_name);
+    printf("  Compares the calls/sec of the allocating transfer path with spi_transfer\n");
+    printf("  (pooled scratch buffers) and spi_transfer_iov (caller owned buffers).\n");
+}
+
+static int parse_command(const char *str, uint8_t *out) {
+    int len = 0;
+
+    while (*str) {
+        char *end;
+        long  val = strtol(str, &end, 16);
+        if (end == str)
+            break;
+        if (len >= MAX_CMD_SIZE || val < 0 || val > 0xFF)
+            return -1;
+        out[len++] = (uint8_t) val;
+        str        = end;
+    }
+    return len;
+}
+
+// The transfer path before pooled buffers: two callocs, two copies and two frees per call
+static int legacy_transfer(spi_config_t *self, const uint8_t *tx_buffer, uint16_t tx_length, uint8_t *rx_buffer,
+                           uint16_t rx_length) {
+    uint16_t total_length   = tx_length + rx_length;
+    uint8_t *full_tx_buffer = calloc(total_length, sizeof(uint8_t));
+    uint8_t *full_rx_buffer = calloc(total_length, sizeof(uint8_t));
+    int      ret            = -1;
+
+    if (full_tx_buffer && full_rx_buffer) {
+        memcpy(full_tx_buffer, tx_buffer, tx_length);
+
+        struct spi_ioc_transfer xfer = {.tx_buf        = (unsigned long) full_tx_buffer,
+                                        .rx_buf        = (unsigned long) full_rx_buffer,
+                                        .len           = total_length,
+                                        .speed_hz      = self->speed,
+                                        .bits_per_word = self->bits};
+
+        if (ioctl(self->spidev_fd, SPI_IOC_MESSAGE(1), &xfer) >= 0) {
+            memcpy(rx_buffer, full_rx_buffer, rx_length);
+            ret = 0;
+        }
+    }
+
+    free(full_tx_buffer);
+    free(full_rx_buffer);
+    return ret;
+}
+
+typedef enum { MODE_LEGACY, MODE_POOLED, MODE_IOV } bench_mode_t;
+
+// Run one transfer flavour for the given time and return calls/sec
+static double run(spi_config_t *spi, bench_mode_t mode, const uint8_t *command, int command_len, int rx_length,
+                  double duration) {
+    static uint8_t tx_buffer[2 * MAX_CMD_SIZE];
+    static uint8_t rx_buffer[2 * MAX_CMD_SIZE];
+    uint64_t       calls = 0;
+    double         start = now_seconds();
+    double         elapsed;
+
+    // The iovec call sends the command and dummy bytes from a caller owned buffer
+    memset(tx_buffer, 0, sizeof(tx_buffer));
+    memcpy(tx_buffer, command, command_len);
+    spi_iov_t iov = {.tx_buffer = tx_buffer, .rx_buffer = rx_buffer, .length = command_len + rx_length};
+
+    do {
+        for (int i = 0; i < 256; i++) {
+            int ret;
+            if (mode == MODE_LEGACY) {
+                ret = legacy_transfer(spi, command, command_len, rx_buffer, rx_length);
+            } else if (mode == MODE_POOLED) {
+                ret = spi_transfer(spi, command, command_len, rx_buffer, rx_length);
+            } else {
+                ret = spi_transfer_iov(spi, &iov, 1);
+            }
+            if (ret < 0) {
+                printf("Error: SPI transfer failed: %s\n", strerror(errno));
+                return -1;
+            }
+        }
+        calls += 256;
+        elapsed = now_seconds() - start;
+    } while (elapsed < duration);
+
+    return calls / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    uint8_t command[MAX_CMD_SIZE];
+    int     command_len = parse_command(argv[2], command);
+    int     rx_length   = argc > 3 ? atoi(argv[3]) : 4;
+    double  duration    = argc > 4 ? atof(argv[4]) : 2.0;
+
+    if (command_len <= 0 || rx_length < 0 || rx_length > MAX_CMD_SIZE || duration <= 0) {
+        printf("Error: Invalid arguments\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    spi_config_t spi = {
+            .device    = argv[1],
+            .mode      = SPI_MODE_0,
+            .bits      = 8,
+            .speed     = 500000,
+            .spidev_fd = -1,
+    };
+    if (spi_init(&spi) < 0) {
+        return 1;
+    }
+
+    static const char *names[] = {"calloc per call", "spi_transfer", "spi_transfer_iov"};
+    double             rates[3];
+
+    printf("\n%-18s %14s %10s\n", "path", "calls/sec", "ns/call");
+    for (int mode = MODE_LEGACY; mode <= MODE_IOV; mode++) {
+        rates[mode] = run(&spi, mode, command, command_len, rx_length, duration);
+        if (rates[mode] < 0) {
+            spi_deinit(&spi);
+            return 1;
+        }
+        printf("%-18s %14.0f %10.0f\n", names[mode], rates[mode], 1e9 / rates[mode]);
+    }
+    printf("speedup: spi_transfer %.2fx, spi_transfer_iov %.2fx\n", rates[MODE_POOLED] / rates[MODE_LEGACY],
+           rates[MODE_IOV] / rates[MODE_LEGACY]);
+
+    spi_deinit(&spi);
+    return 0;
+}